@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+
+#include "ngh/io/gzipreader.h"
+#include "ngh/io/mmapreader.h"
+
+namespace ngh::io {
+
+// Line source for a capture file, picking the reader from the file name:
+// gzip for *.gz, memory mapped otherwise.
+class CaptureReader {
+ public:
+  explicit CaptureReader(const std::string& path) {
+    if (path.ends_with(".gz")) {
+      reader_.emplace<GzipLineReader>(path);
+    } else {
+      reader_.emplace<MmapLineReader>(path);
+    }
+  }
+
+  bool next(std::string_view& line) {
+    return std::visit(
+        [&line](auto& r) {
+          if constexpr (std::is_same_v<decltype(r), std::monostate&>) {
+            return false;
+          } else {
+            return r.next(line);
+          }
+        },
+        reader_);
+  }
+
+  // Only uncompressed captures can be entered at an offset.
+  bool seekable() const {
+    return std::holds_alternative<MmapLineReader>(reader_);
+  }
+  size_t tell() const {
+    if (const auto* r = std::get_if<MmapLineReader>(&reader_)) {
+      return r->tell();
+    }
+    throw std::invalid_argument("cannot seek in a compressed capture");
+  }
+  void seek(const size_t offset) {
+    if (auto* r = std::get_if<MmapLineReader>(&reader_)) {
+      return r->seek(offset);
+    }
+    throw std::invalid_argument("cannot seek in a compressed capture");
+  }
+
+ private:
+  std::variant<std::monostate, MmapLineReader, GzipLineReader> reader_;
+};
+
+}  // namespace ngh::io
@@ -0,0 +1,392 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace ngh::io {
+
+// Normalized exchange events as fixed-width binary records, so research
+// replays skip json parsing entirely. A log is a Header followed by 32 byte
+// records in capture order. Names (markets and currencies) are interned:
+// a kSymbol record, followed by the name padded to whole records, introduces
+// each one before first use and records refer to it by its dense symbol id.
+//
+// A log may also embed kCheckpoint records: an opaque state image (see
+// ftxstate.h) of everything before it, padded to whole records like names.
+// A closed log ends with a trailer listing checkpoints and symbol records,
+// so readers can enter it at any checkpoint without a scan.
+//
+// Record payloads by type:
+//   kL2Begin  market, flags kPartial; starts an orderbook update
+//   kLevel    market, px, qty (0 removes), flags kSell
+//   kL2End    market
+//   kTrade    market, px, qty (signed), flags kLiquidation
+//   kFill     market, px, qty (signed), sym fee currency; then kAux with
+//             ns = order id, px = fee
+//   kOrder    market, px price, qty size, sym order type name, flags side,
+//             status and order flags; then kAux with ns = order id, px
+//             filled size, qty remaining size (NaN if a close didn't
+//             carry them)
+// Native endianness, like the state images in ftxstate.h.
+struct EventRecord {
+  enum Type : uint8_t {
+    kSymbol,
+    kL2Begin,
+    kLevel,
+    kL2End,
+    kTrade,
+    kFill,
+    kOrder,
+    kAux,
+    kCheckpoint,  // ns, market = image size in bytes
+  };
+  enum Flags : uint8_t {
+    kSell = 1,
+    kPartial = 2,
+    kLiquidation = 2,
+    kClosed = 2,
+    kReduceOnly = 4,
+    kPostOnly = 8,
+    kIoc = 16,
+    kNew = 32,  // order status "new", otherwise "open" unless closed
+  };
+
+  int64_t ns;  // event time, the order id in kAux records
+  double px;
+  double qty;
+  uint32_t market;  // symbol id, the interned id in kSymbol records
+  uint8_t type;
+  uint8_t flags;
+  uint16_t sym;  // symbol id, the name length in kSymbol records
+};
+static_assert(sizeof(EventRecord) == 32);
+
+struct EventLogHeader {
+  static constexpr uint32_t kMagic = 0x4c45474e;  // "NGEL"
+  static constexpr uint32_t kVersion = 1;
+
+  uint32_t magic;
+  uint32_t version;
+  uint32_t recordSize;
+  uint32_t pad;
+  // Filled in on close; an unclosed log is all records, without a trailer
+  uint64_t numRecords;
+  uint64_t numCheckpoints;
+  uint64_t numSymbols;
+};
+
+// Trailer entries: numCheckpoints of these, then numSymbols record indices.
+struct EventLogCheckpoint {
+  int64_t ns;
+  uint64_t record;  // index of the kCheckpoint record
+};
+
+// Records taking `bytes` of payload.
+constexpr size_t recordsFor(const size_t bytes) {
+  return (bytes + sizeof(EventRecord) - 1) / sizeof(EventRecord);
+}
+
+// Seconds as doubles (the feed's unit) to and from int64 ns; the whole and
+// fractional parts are converted separately to keep sub-microsecond digits.
+inline int64_t toNs(const double ts) {
+  const double s = std::floor(ts);
+  return int64_t(s) * 1000000000 + std::llround((ts - s) * 1e9);
+}
+inline double fromNs(const int64_t ns) {
+  return double(ns / 1000000000) + double(ns % 1000000000) * 1e-9;
+}
+
+// Buffered writer of an event log, interning names as they are used.
+class EventLogWriter {
+ public:
+  static constexpr size_t kBufferRecords = 32 * 1024;
+
+  explicit EventLogWriter(const std::string& path)
+      : fd_(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)) {
+    if (fd_ < 0) {
+      throw std::runtime_error("failed to open " + path + ": " +
+                               std::strerror(errno));
+    }
+    buffer_.reserve(kBufferRecords);
+    const EventLogHeader header{EventLogHeader::kMagic,
+                                EventLogHeader::kVersion, sizeof(EventRecord)};
+    writeAll(&header, sizeof(header));
+  }
+  EventLogWriter(const EventLogWriter&) = delete;
+  EventLogWriter& operator=(const EventLogWriter&) = delete;
+  ~EventLogWriter() {
+    if (fd_ >= 0) {
+      try {
+        close();
+      } catch (const std::exception&) {
+      }
+    }
+  }
+
+  uint32_t intern(const std::string_view name) {
+    auto it = symbols_.find(name);
+    if (it != symbols_.end()) {
+      return it->second;
+    }
+    if (name.size() > UINT16_MAX) {
+      throw std::invalid_argument("symbol name too long");
+    }
+    const auto id = uint32_t(symbols_.size());
+    symbols_.emplace(name, id);
+    symbolRecords_.push_back(count_);
+    EventRecord r{};
+    r.type = EventRecord::kSymbol;
+    r.market = id;
+    r.sym = uint16_t(name.size());
+    write(r);
+    writeBytes(name);
+    return id;
+  }
+
+  // Embeds a state image as of `ns`, covering everything written so far.
+  void checkpoint(const int64_t ns, const std::string_view image) {
+    if (image.size() > UINT32_MAX) {
+      throw std::invalid_argument("checkpoint image too large");
+    }
+    checkpoints_.push_back({ns, count_});
+    EventRecord r{};
+    r.ns = ns;
+    r.type = EventRecord::kCheckpoint;
+    r.market = uint32_t(image.size());
+    write(r);
+    writeBytes(image);
+  }
+
+  void write(const EventRecord& r) {
+    buffer_.push_back(r);
+    ++count_;
+    if (buffer_.size() == kBufferRecords) {
+      flush();
+    }
+  }
+
+  void flush() {
+    writeAll(buffer_.data(), buffer_.size() * sizeof(EventRecord));
+    buffer_.clear();
+  }
+  // Writes the trailer; the log can't be appended to after.
+  void close() {
+    flush();
+    writeAll(checkpoints_.data(),
+             checkpoints_.size() * sizeof(EventLogCheckpoint));
+    writeAll(symbolRecords_.data(), symbolRecords_.size() * sizeof(uint64_t));
+    EventLogHeader header{EventLogHeader::kMagic, EventLogHeader::kVersion,
+                          sizeof(EventRecord)};
+    header.numRecords = count_;
+    header.numCheckpoints = checkpoints_.size();
+    header.numSymbols = symbolRecords_.size();
+    if (::pwrite(fd_, &header, sizeof(header), 0) != sizeof(header)) {
+      throw std::runtime_error("failed to write event log header");
+    }
+    if (::close(std::exchange(fd_, -1)) != 0) {
+      throw std::runtime_error("failed to close event log");
+    }
+  }
+
+  // Records written, including symbols.
+  size_t count() const { return count_; }
+
+ private:
+  void writeBytes(const std::string_view bytes) {
+    for (size_t i = 0; i < bytes.size(); i += sizeof(EventRecord)) {
+      EventRecord chunk{};
+      std::memcpy(&chunk, bytes.data() + i,
+                  std::min(sizeof(EventRecord), bytes.size() - i));
+      write(chunk);
+    }
+  }
+
+  void writeAll(const void* data, size_t size) {
+    const auto* p = static_cast<const char*>(data);
+    while (size) {
+      const ssize_t n = ::write(fd_, p, size);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw std::runtime_error(std::string("failed to write event log: ") +
+                                 std::strerror(errno));
+      }
+      p += n;
+      size -= n;
+    }
+  }
+
+  int fd_;
+  std::vector<EventRecord> buffer_;
+  std::map<std::string, uint32_t, std::less<>> symbols_;
+  std::vector<uint64_t> symbolRecords_;
+  std::vector<EventLogCheckpoint> checkpoints_;
+  size_t count_{0};
+};
+
+// Memory mapped reader of an event log. next() hands out every record but
+// kSymbol and kCheckpoint ones; names are collected into symbol() as they
+// are passed (all of them up front for a closed log).
+class EventLogReader {
+ public:
+  explicit EventLogReader(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("failed to open " + path + ": " +
+                               std::strerror(errno));
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      ::close(fd);
+      throw std::runtime_error("failed to stat " + path);
+    }
+    size_ = st.st_size;
+    if (size_ < sizeof(EventLogHeader)) {
+      ::close(fd);
+      throw std::runtime_error(path + " is not an event log");
+    }
+    void* base = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+      throw std::runtime_error("failed to map " + path + ": " +
+                               std::strerror(errno));
+    }
+    data_ = static_cast<const char*>(base);
+    ::madvise(base, size_, MADV_SEQUENTIAL);
+    EventLogHeader header;
+    std::memcpy(&header, data_, sizeof(header));
+    if (header.magic != EventLogHeader::kMagic ||
+        header.version != EventLogHeader::kVersion ||
+        header.recordSize != sizeof(EventRecord)) {
+      ::munmap(const_cast<char*>(data_), size_);
+      throw std::runtime_error(path + " is not a version " +
+                               std::to_string(EventLogHeader::kVersion) +
+                               " event log");
+    }
+    records_ = reinterpret_cast<const EventRecord*>(data_ + sizeof(header));
+    count_ = (size_ - sizeof(header)) / sizeof(EventRecord);
+    if (header.numRecords) {
+      loadTrailer(header, path);
+    }
+  }
+  EventLogReader(EventLogReader&& o) noexcept
+      : data_(std::exchange(o.data_, nullptr)),
+        size_(o.size_),
+        records_(o.records_),
+        count_(o.count_),
+        pos_(o.pos_),
+        symbols_(std::move(o.symbols_)),
+        checkpoints_(std::move(o.checkpoints_)) {}
+  EventLogReader(const EventLogReader&) = delete;
+  EventLogReader& operator=(const EventLogReader&) = delete;
+  ~EventLogReader() {
+    if (data_) {
+      ::munmap(const_cast<char*>(data_), size_);
+    }
+  }
+
+  // Returns nullptr once the log is exhausted.
+  const EventRecord* next() {
+    while (pos_ < count_) {
+      const EventRecord* r = records_ + pos_++;
+      if (r->type == EventRecord::kSymbol) {
+        const auto name = payload(r, r->sym);
+        if (r->market == symbols_.size()) {
+          symbols_.push_back(name);
+        } else if (r->market > symbols_.size()) {
+          throw std::runtime_error("corrupt event log");
+        }
+      } else if (r->type == EventRecord::kCheckpoint) {
+        payload(r, r->market);
+      } else {
+        return r;
+      }
+    }
+    return nullptr;
+  }
+
+  // Names seen so far, views into the mapping.
+  std::string_view symbol(const uint32_t id) const { return symbols_.at(id); }
+  size_t numSymbols() const { return symbols_.size(); }
+
+  // Record index of the next record; seek() takes one at a record boundary
+  // (a tell() or a checkpoint's record).
+  size_t tell() const { return pos_; }
+  void seek(const size_t record) { pos_ = std::min(record, count_); }
+  size_t count() const { return count_; }
+
+  // Embedded checkpoints in log order, empty for an unclosed log.
+  const std::vector<EventLogCheckpoint>& checkpoints() const {
+    return checkpoints_;
+  }
+  // The state image of a checkpoint, a view into the mapping.
+  std::string_view image(const EventLogCheckpoint& c) const {
+    const EventRecord* r = records_ + c.record;
+    if (c.record >= count_ || r->type != EventRecord::kCheckpoint ||
+        c.record + 1 + recordsFor(r->market) > count_) {
+      throw std::runtime_error("corrupt event log");
+    }
+    return {reinterpret_cast<const char*>(r + 1), r->market};
+  }
+
+ private:
+  // Skips the payload following `r`, which is now at pos_.
+  std::string_view payload(const EventRecord* r, const size_t bytes) {
+    const size_t n = recordsFor(bytes);
+    if (pos_ + n > count_) {
+      throw std::runtime_error("corrupt event log");
+    }
+    pos_ += n;
+    return {reinterpret_cast<const char*>(r + 1), bytes};
+  }
+
+  void loadTrailer(const EventLogHeader& header, const std::string& path) {
+    const char* trailer = reinterpret_cast<const char*>(
+        records_ + std::min<size_t>(header.numRecords, count_));
+    if (header.numRecords > count_ ||
+        size_t(data_ + size_ - trailer) !=
+            header.numCheckpoints * sizeof(EventLogCheckpoint) +
+                header.numSymbols * sizeof(uint64_t)) {
+      throw std::runtime_error(path + ": corrupt event log trailer");
+    }
+    count_ = header.numRecords;
+    checkpoints_.resize(header.numCheckpoints);
+    std::memcpy(checkpoints_.data(), trailer,
+                checkpoints_.size() * sizeof(EventLogCheckpoint));
+    trailer += checkpoints_.size() * sizeof(EventLogCheckpoint);
+    for (uint64_t i = 0; i < header.numSymbols; ++i) {
+      uint64_t record;
+      std::memcpy(&record, trailer + i * sizeof(record), sizeof(record));
+      const EventRecord* r = records_ + record;
+      if (record >= count_ || r->type != EventRecord::kSymbol ||
+          r->market != i || record + 1 + recordsFor(r->sym) > count_) {
+        throw std::runtime_error(path + ": corrupt event log trailer");
+      }
+      symbols_.emplace_back(reinterpret_cast<const char*>(r + 1), r->sym);
+    }
+  }
+
+  const char* data_{nullptr};
+  size_t size_{0};
+  const EventRecord* records_{nullptr};
+  size_t count_{0};
+  size_t pos_{0};
+  std::vector<std::string_view> symbols_;
+  std::vector<EventLogCheckpoint> checkpoints_;
+};
+
+}  // namespace ngh::io
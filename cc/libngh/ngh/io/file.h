@@ -0,0 +1,97 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace ngh::io {
+
+// Whole file helpers for small sidecar files.
+
+inline bool fileExists(const std::string& path) {
+  struct stat st;
+  return ::stat(path.c_str(), &st) == 0;
+}
+
+// Size and modification time, to tell if what was derived from a file is
+// stale.
+struct FileStamp {
+  uint64_t size;
+  int64_t mtimeNs;
+
+  bool operator==(const FileStamp&) const = default;
+};
+
+inline FileStamp fileStamp(const std::string& path) {
+  struct stat st;
+  if (::stat(path.c_str(), &st) != 0) {
+    throw std::runtime_error("failed to stat " + path + ": " +
+                             std::strerror(errno));
+  }
+  return {uint64_t(st.st_size),
+          int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec};
+}
+
+inline std::string readFile(const std::string& path) {
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("failed to open " + path + ": " +
+                             std::strerror(errno));
+  }
+  std::string out;
+  char buf[1 << 16];
+  for (;;) {
+    const ssize_t n = ::read(fd, buf, sizeof(buf));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      ::close(fd);
+      throw std::runtime_error("failed to read " + path + ": " +
+                               std::strerror(errno));
+    }
+    if (n == 0) {
+      break;
+    }
+    out.append(buf, n);
+  }
+  ::close(fd);
+  return out;
+}
+
+// Writes to a temporary next to `path` and renames it over `path`, so
+// readers never see a partial file.
+inline void writeFile(const std::string& path, std::string_view data) {
+  const auto tmp = path + ".tmp";
+  const int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    throw std::runtime_error("failed to open " + tmp + ": " +
+                             std::strerror(errno));
+  }
+  while (!data.empty()) {
+    const ssize_t n = ::write(fd, data.data(), data.size());
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      const int err = errno;
+      ::close(fd);
+      ::unlink(tmp.c_str());
+      throw std::runtime_error("failed to write " + tmp + ": " +
+                               std::strerror(err));
+    }
+    data.remove_prefix(n);
+  }
+  if (::close(fd) != 0 || ::rename(tmp.c_str(), path.c_str()) != 0) {
+    ::unlink(tmp.c_str());
+    throw std::runtime_error("failed to write " + path);
+  }
+}
+
+}  // namespace ngh::io
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "simdjson.h"
+
+namespace ngh::io {
+
+// Reads newline delimited records from a file in large blocks. Lines are
+// views into the block buffer, valid until the next call to next(), and are
+// followed by at least SIMDJSON_PADDING readable bytes.
+class FileLineReader {
+ public:
+  static constexpr size_t kBlockSize = 1 << 20;
+
+  explicit FileLineReader(const std::string& path)
+      : fd_(::open(path.c_str(), O_RDONLY)),
+        buf_(kBlockSize + simdjson::SIMDJSON_PADDING) {
+    if (fd_ < 0) {
+      throw std::runtime_error("failed to open " + path + ": " +
+                               std::strerror(errno));
+    }
+  }
+  FileLineReader(FileLineReader&& o) noexcept
+      : fd_(std::exchange(o.fd_, -1)),
+        buf_(std::move(o.buf_)),
+        begin_(o.begin_),
+        end_(o.end_),
+        eof_(o.eof_) {}
+  FileLineReader(const FileLineReader&) = delete;
+  FileLineReader& operator=(const FileLineReader&) = delete;
+  ~FileLineReader() {
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+
+  // Skips empty lines; returns false once the file is exhausted.
+  bool next(std::string_view& line) {
+    while (true) {
+      const char* begin = buf_.data() + begin_;
+      const auto* nl =
+          static_cast<const char*>(std::memchr(begin, '\n', end_ - begin_));
+      if (nl) {
+        line = {begin, size_t(nl - begin)};
+        begin_ += line.size() + 1;
+        if (line.empty()) {
+          continue;
+        }
+        return true;
+      }
+      if (eof_) {
+        line = {begin, end_ - begin_};
+        begin_ = end_;
+        return !line.empty();
+      }
+      fill();
+    }
+  }
+
+ private:
+  // Moves the partial line to the front and reads another block after it,
+  // growing the buffer for lines longer than a block.
+  void fill() {
+    std::memmove(buf_.data(), buf_.data() + begin_, end_ - begin_);
+    end_ -= begin_;
+    begin_ = 0;
+    if (buf_.size() - end_ < kBlockSize + simdjson::SIMDJSON_PADDING) {
+      buf_.resize(end_ + kBlockSize + simdjson::SIMDJSON_PADDING);
+    }
+    const auto n = ::read(fd_, buf_.data() + end_, kBlockSize);
+    if (n < 0) {
+      throw std::runtime_error(std::string("read failed: ") +
+                               std::strerror(errno));
+    }
+    eof_ = n == 0;
+    end_ += n;
+  }
+
+  int fd_;
+  std::vector<char> buf_;
+  size_t begin_{0};
+  size_t end_{0};
+  bool eof_{false};
+};
+
+}  // namespace ngh::io
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "simdjson.h"
+
+namespace ngh::io {
+
+// Streams lines out of a gzip (or concatenated gzip) capture. A dedicated
+// thread inflates into a small ring of padded blocks while the caller parses
+// the previous ones. Each block is cut after its last newline, with the
+// partial line carried over to the start of the next block by the inflate
+// thread, so lines are handed out as views into the block (valid until the
+// next call to next()) and are followed by SIMDJSON_PADDING readable bytes.
+class GzipLineReader {
+ public:
+  static constexpr size_t kBlockSize = 4 << 20;
+  static constexpr size_t kNumBlocks = 4;
+  static constexpr size_t kInputSize = 1 << 20;
+
+  explicit GzipLineReader(const std::string& path)
+      : fd_(::open(path.c_str(), O_RDONLY)), blocks_(kNumBlocks) {
+    if (fd_ < 0) {
+      throw std::runtime_error("failed to open " + path + ": " +
+                               std::strerror(errno));
+    }
+    thread_ = std::thread([this] { run(); });
+  }
+  GzipLineReader(const GzipLineReader&) = delete;
+  GzipLineReader& operator=(const GzipLineReader&) = delete;
+  ~GzipLineReader() {
+    {
+      std::lock_guard lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+    ::close(fd_);
+  }
+
+  // Skips empty lines; returns false once the stream is exhausted.
+  bool next(std::string_view& line) {
+    while (true) {
+      if (cur_) {
+        while (pos_ < cur_->size) {
+          const char* begin = cur_->data.data() + pos_;
+          const auto* nl = static_cast<const char*>(
+              std::memchr(begin, '\n', cur_->size - pos_));
+          const size_t len = nl ? nl - begin : cur_->size - pos_;
+          pos_ += len + 1;
+          if (len) {
+            line = {begin, len};
+            return true;
+          }
+        }
+      }
+      if (!nextBlock()) {
+        return false;
+      }
+    }
+  }
+
+ private:
+  struct Block {
+    std::vector<char> data;
+    size_t size{0};
+  };
+
+  // consumer: releases the current block and waits for the next one
+  bool nextBlock() {
+    std::unique_lock lock(mutex_);
+    if (cur_) {
+      cur_ = nullptr;
+      ++head_;
+      cv_.notify_all();
+    }
+    cv_.wait(lock, [this] { return head_ < tail_ || done_; });
+    if (head_ == tail_) {
+      if (error_) {
+        std::rethrow_exception(error_);
+      }
+      return false;
+    }
+    cur_ = &blocks_[head_ % kNumBlocks];
+    pos_ = 0;
+    return true;
+  }
+
+  // producer: waits for a free block, nullptr when stopping
+  Block* acquire() {
+    std::unique_lock lock(mutex_);
+    cv_.wait(lock, [this] { return tail_ - head_ < kNumBlocks || stop_; });
+    return stop_ ? nullptr : &blocks_[tail_ % kNumBlocks];
+  }
+
+  void publish(const bool done) {
+    {
+      std::lock_guard lock(mutex_);
+      ++tail_;
+      done_ = done;
+    }
+    cv_.notify_all();
+  }
+
+  void run() {
+    z_stream zs{};
+    inflateInit2(&zs, 15 + 32);  // gzip or zlib header
+    try {
+      inflateAll(zs);
+    } catch (...) {
+      std::lock_guard lock(mutex_);
+      error_ = std::current_exception();
+      done_ = true;
+    }
+    cv_.notify_all();
+    inflateEnd(&zs);
+  }
+
+  void inflateAll(z_stream& zs) {
+    std::vector<unsigned char> in(kInputSize);
+    std::string carry;
+    bool finished = false;
+    while (!finished) {
+      Block* b = acquire();
+      if (!b) {
+        return;
+      }
+      if (b->data.size() < carry.size() + kBlockSize) {
+        b->data.resize(carry.size() + kBlockSize + simdjson::SIMDJSON_PADDING);
+      }
+      std::memcpy(b->data.data(), carry.data(), carry.size());
+      b->size = carry.size();
+      while (true) {
+        const size_t cap = b->data.size() - simdjson::SIMDJSON_PADDING;
+        finished = fill(zs, in, *b, cap);
+        if (finished) {
+          carry.clear();
+          break;
+        }
+        const auto* begin = b->data.data();
+        const auto* nl = static_cast<const char*>(
+            ::memrchr(begin, '\n', b->size));
+        if (nl) {
+          const size_t end = nl - begin + 1;
+          carry.assign(begin + end, b->size - end);
+          b->size = end;
+          break;
+        }
+        // a single line longer than the block
+        b->data.resize(2 * cap + simdjson::SIMDJSON_PADDING);
+      }
+      publish(finished);
+    }
+  }
+
+  // Inflates into `b` up to `cap` bytes; true at the end of the input,
+  // which must not cut a member short.
+  bool fill(z_stream& zs, std::vector<unsigned char>& in, Block& b,
+            const size_t cap) {
+    while (b.size < cap) {
+      if (zs.avail_in == 0) {
+        const auto n = ::read(fd_, in.data(), in.size());
+        if (n < 0) {
+          throw std::runtime_error(std::string("read failed: ") +
+                                   std::strerror(errno));
+        }
+        if (n == 0) {
+          if (inMember_) {
+            throw std::runtime_error("truncated gzip input");
+          }
+          return true;
+        }
+        zs.next_in = in.data();
+        zs.avail_in = n;
+      }
+      zs.next_out = reinterpret_cast<unsigned char*>(b.data.data() + b.size);
+      zs.avail_out = cap - b.size;
+      inMember_ = true;
+      const int ret = inflate(&zs, Z_NO_FLUSH);
+      b.size = cap - zs.avail_out;
+      if (ret == Z_STREAM_END) {
+        inMember_ = false;
+        inflateReset(&zs);  // concatenated members
+      } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+        throw std::runtime_error(std::string("inflate failed: ") +
+                                 (zs.msg ? zs.msg : "corrupt input"));
+      }
+    }
+    return false;
+  }
+
+  int fd_;
+  std::vector<Block> blocks_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  size_t head_{0};  // blocks consumed
+  size_t tail_{0};  // blocks published
+  bool done_{false};
+  bool stop_{false};
+  std::exception_ptr error_;
+  std::thread thread_;
+
+  // producer only
+  bool inMember_{false};  // input fed since the last member ended
+
+  // consumer only
+  Block* cur_{nullptr};
+  size_t pos_{0};
+};
+
+}  // namespace ngh::io
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "ngh/io/capturereader.h"
+#include "ngh/io/scan.h"
+
+namespace ngh::io {
+
+// Line source merging several captures by time while streaming, e.g.
+// orderbooks split across connections plus a fills/orders feed. Each file
+// keeps its own reader (memory mapped or gzip, see CaptureReader) and only
+// its current line is held, in a min-heap keyed by time.
+//
+// FTX messages carry no receive time, so the key is their event time
+// (scanAnyTime()); lines without one inherit the key of the line before them
+// in the same file, which keeps every file in its own order. Ties go to the
+// file listed first. Lines are valid until the following next().
+class MergedLineReader {
+ public:
+  explicit MergedLineReader(const std::vector<std::string>& paths) {
+    for (const auto& path : paths) {
+      sources_.emplace_back(path);
+    }
+    for (size_t i = 0; i < sources_.size(); ++i) {
+      advance(i);
+    }
+  }
+
+  bool next(std::string_view& line) {
+    if (last_ < sources_.size()) {
+      advance(last_);  // its previous line is no longer in use
+    }
+    if (heap_.empty()) {
+      last_ = sources_.size();
+      return false;
+    }
+    last_ = heap_.top().second;
+    heap_.pop();
+    line = sources_[last_].line;
+    return true;
+  }
+
+  size_t numSources() const { return sources_.size(); }
+
+ private:
+  struct Source {
+    explicit Source(const std::string& path) : reader(path) {}
+    CaptureReader reader;
+    std::string_view line;
+    double key{-INFINITY};
+  };
+  using Entry = std::pair<double, size_t>;  // (key, source)
+
+  void advance(const size_t i) {
+    auto& s = sources_[i];
+    if (!s.reader.next(s.line)) {
+      return;
+    }
+    const double t = scanAnyTime(s.line);
+    if (!std::isnan(t)) {
+      s.key = t;
+    }
+    heap_.emplace(s.key, i);
+  }
+
+  std::deque<Source> sources_;  // readers are not movable
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<>> heap_;
+  size_t last_{SIZE_MAX};
+};
+
+}  // namespace ngh::io
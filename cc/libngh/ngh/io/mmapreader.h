@@ -0,0 +1,130 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "simdjson.h"
+
+namespace ngh::io {
+
+// Memory maps a newline delimited file and hands out lines as views into the
+// mapping, with no read syscalls or copies. The file is mapped over a
+// slightly larger anonymous reservation, so even the last line is followed
+// by SIMDJSON_PADDING readable (zero) bytes and can be parsed in place.
+//
+// Pages behind the cursor are dropped every kDropBehind bytes, both from the
+// mapping and from the page cache, so a 10GB+ replay neither grows RSS nor
+// evicts everything else.
+class MmapLineReader {
+ public:
+  static constexpr size_t kDropBehind = 64 << 20;
+
+  explicit MmapLineReader(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("failed to open " + path + ": " +
+                               std::strerror(errno));
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      ::close(fd);
+      throw std::runtime_error("failed to stat " + path);
+    }
+    size_ = st.st_size;
+    const size_t page = ::sysconf(_SC_PAGESIZE);
+    mapped_ = (size_ + page - 1) / page * page +
+              (simdjson::SIMDJSON_PADDING + page - 1) / page * page;
+    void* base = ::mmap(nullptr, mapped_, PROT_READ,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base != MAP_FAILED && size_ &&
+        ::mmap(base, size_, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) ==
+            MAP_FAILED) {
+      ::munmap(base, mapped_);
+      base = MAP_FAILED;
+    }
+    fd_ = fd;
+    if (base == MAP_FAILED) {
+      ::close(fd_);
+      throw std::runtime_error("failed to map " + path + ": " +
+                               std::strerror(errno));
+    }
+    data_ = static_cast<const char*>(base);
+    ::madvise(base, size_, MADV_SEQUENTIAL);
+  }
+  MmapLineReader(MmapLineReader&& o) noexcept
+      : data_(std::exchange(o.data_, nullptr)),
+        size_(o.size_),
+        mapped_(o.mapped_),
+        pos_(o.pos_),
+        dropped_(o.dropped_),
+        fd_(std::exchange(o.fd_, -1)) {}
+  MmapLineReader(const MmapLineReader&) = delete;
+  MmapLineReader& operator=(const MmapLineReader&) = delete;
+  ~MmapLineReader() {
+    if (data_) {
+      ::munmap(const_cast<char*>(data_), mapped_);
+    }
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+
+  // Skips empty lines; returns false once the file is exhausted.
+  bool next(std::string_view& line) {
+    while (pos_ < size_) {
+      const char* begin = data_ + pos_;
+      const auto* nl =
+          static_cast<const char*>(std::memchr(begin, '\n', size_ - pos_));
+      const size_t len = nl ? nl - begin : size_ - pos_;
+      pos_ += len + 1;
+      if (pos_ - dropped_ >= 2 * kDropBehind) {
+        dropBehind();
+      }
+      if (len) {
+        line = {begin, len};
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Byte offset of the next line; seek() takes an offset at a line start.
+  size_t tell() const { return std::min(pos_, size_); }
+  void seek(const size_t offset) {
+    pos_ = std::min(offset, size_);
+    if (pos_ < dropped_) {  // dropped pages fault back in from the file
+      const size_t page = ::sysconf(_SC_PAGESIZE);
+      dropped_ = pos_ / page * page;
+    }
+  }
+  size_t size() const { return size_; }
+
+ private:
+  // Keeps the last kDropBehind bytes, the current line may still be in there
+  void dropBehind() {
+    const size_t page = ::sysconf(_SC_PAGESIZE);
+    const size_t until = (pos_ - kDropBehind) / page * page;
+    ::madvise(const_cast<char*>(data_) + dropped_, until - dropped_,
+              MADV_DONTNEED);
+    ::posix_fadvise(fd_, dropped_, until - dropped_, POSIX_FADV_DONTNEED);
+    dropped_ = until;
+  }
+
+  const char* data_{nullptr};
+  size_t size_{0};
+  size_t mapped_{0};
+  size_t pos_{0};
+  size_t dropped_{0};
+  int fd_{-1};
+};
+
+}  // namespace ngh::io
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <string_view>
+
+namespace ngh::io {
+
+// Cheap pre-parse helpers for raw FTX messages, used to order or route lines
+// without running the full parser. They rely on the line being followed by
+// non-numeric bytes (always true for json objects).
+
+// ASCII only, so no locale and no undefined behaviour for bytes over 0x7f
+// (std::isdigit on a negative char).
+constexpr bool isDigit(const char c) { return c >= '0' && c <= '9'; }
+
+// First numeric "time" field, i.e. the orderbook event time, or NaN.
+inline double scanTime(const std::string_view line) {
+  constexpr std::string_view kKey = "\"time\":";
+  for (auto pos = line.find(kKey); pos != std::string_view::npos;
+       pos = line.find(kKey, pos + kKey.size())) {
+    auto i = pos + kKey.size();
+    while (i < line.size() && line[i] == ' ') {
+      ++i;
+    }
+    if (i < line.size() && isDigit(line[i])) {
+      return std::strtod(line.data() + i, nullptr);
+    }
+  }
+  return NAN;
+}
+
+// Seconds since the epoch of an ISO 8601 UTC time as FTX writes them, e.g.
+// "2021-01-01T00:00:00.123456+00:00", or NaN if it doesn't look like one.
+inline double parseIsoTime(const std::string_view s) {
+  const auto num = [&s](size_t pos, size_t len, int& out) {
+    if (pos + len > s.size()) {
+      return false;
+    }
+    out = 0;
+    for (size_t i = pos; i < pos + len; ++i) {
+      if (!isDigit(s[i])) {
+        return false;
+      }
+      out = out * 10 + (s[i] - '0');
+    }
+    return true;
+  };
+  int y, m, d, hh, mm, ss;
+  if (!num(0, 4, y) || !num(5, 2, m) || !num(8, 2, d) || !num(11, 2, hh) ||
+      !num(14, 2, mm) || !num(17, 2, ss) || s[4] != '-' || s[10] != 'T') {
+    return NAN;
+  }
+  // days from civil, see http://howardhinnant.github.io/date_algorithms.html
+  y -= m <= 2;
+  const int era = (y >= 0 ? y : y - 399) / 400;
+  const int yoe = y - era * 400;
+  const int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  const int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  const int64_t days = int64_t(era) * 146097 + doe - 719468;
+  double t = days * 86400. + hh * 3600 + mm * 60 + ss;
+  if (s.size() > 19 && s[19] == '.') {
+    double scale = 0.1;
+    for (size_t i = 20; i < s.size() && isDigit(s[i]); ++i) {
+      t += (s[i] - '0') * scale;
+      scale *= 0.1;
+    }
+  }
+  return t;
+}
+
+// First string value of `key` (unescaped, FTX names never need escaping), or
+// empty. The top level "type" and "market" precede "data" in FTX messages.
+inline std::string_view scanString(const std::string_view line,
+                                   const std::string_view key) {
+  for (auto pos = line.find(key); pos != std::string_view::npos;
+       pos = line.find(key, pos + key.size())) {
+    auto i = pos + key.size();
+    if (pos == 0 || line[pos - 1] != '"' || i + 1 >= line.size() ||
+        line[i] != '"' || line[i + 1] != ':') {
+      continue;
+    }
+    i += 2;
+    while (i < line.size() && line[i] == ' ') {
+      ++i;
+    }
+    if (i < line.size() && line[i] == '"') {
+      const auto end = line.find('"', i + 1);
+      if (end != std::string_view::npos) {
+        return line.substr(i + 1, end - i - 1);
+      }
+    }
+  }
+  return {};
+}
+
+// Event time of any FTX message: the orderbook time, else the first ISO
+// "time" string (trades, fills), else NaN.
+inline double scanAnyTime(const std::string_view line) {
+  const double t = scanTime(line);
+  return std::isnan(t) ? parseIsoTime(scanString(line, "time")) : t;
+}
+
+}  // namespace ngh::io
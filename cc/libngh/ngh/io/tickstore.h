@@ -0,0 +1,621 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "ngh/io/eventlog.h"
+#include "ngh/io/varint.h"
+#include "ngh/types/types.h"
+
+namespace ngh::io {
+
+// Columnar store of normalized orderbook updates and trades, several times
+// smaller than the json it comes from and cheaper to decode. Events are cut
+// into blocks per market and hour of event time, each holding its events
+// column by column:
+//   kinds   a TickKind byte per event
+//   times   event times (ns) as zigzag varint deltas of deltas
+//   counts  per orderbook update, the number of bid and ask levels
+//   prices  zigzag varint offsets, in ticks, from the previous price of the
+//           same series: bid levels, ask levels and trades
+//   sizes   varint ticks, trade sizes unsigned (the side is in the kind)
+// A tick is step * 10^-exponent, the coarsest that represents every price
+// (size) of the block exactly; a column with a value that isn't a short
+// decimal falls back to raw doubles.
+//
+// The file is a header, the blocks, then the block index and the names the
+// blocks refer to. Native endianness, like event logs.
+enum TickKind : uint8_t {
+  kTickUpdate = 0,
+  kTickPartial = 1,
+  kTickTrade = 2,
+  kTickTypeMask = 3,
+  kTickSell = 4,  // trades
+  kTickLiquidation = 8,
+};
+
+struct TickStoreHeader {
+  static constexpr uint32_t kMagic = 0x5354474e;  // "NGTS"
+  static constexpr uint32_t kVersion = 1;
+
+  uint32_t magic;
+  uint32_t version;
+  uint64_t numBlocks;
+  uint64_t numSymbols;
+  uint64_t indexOffset;  // 0 until closed
+};
+
+// Block index entry, in replay order: by hour, then as written.
+struct TickBlock {
+  uint32_t market;  // symbol id
+  uint32_t numEvents;
+  int64_t hour;  // ns of the hour the block starts in
+  int64_t firstNs;
+  int64_t lastNs;
+  uint64_t offset;
+  uint64_t size;
+};
+
+struct TickBlockHeader {
+  static constexpr int8_t kRaw = -1;
+  enum Column { kKinds, kTimes, kCounts, kPrices, kSizes, kNumColumns };
+
+  int64_t firstNs;
+  uint32_t numEvents;
+  int8_t pxExponent;  // kRaw for raw doubles
+  int8_t qtyExponent;
+  uint16_t pad;
+  uint64_t pxStep;
+  uint64_t qtyStep;
+  uint32_t columns[kNumColumns];  // sizes in bytes, in this order
+  uint32_t pad2;
+};
+static_assert(sizeof(TickBlockHeader) == 56);
+
+namespace detail {
+
+constexpr int kMaxExponent = 15;
+constexpr double kPow10[kMaxExponent + 1] = {
+    1e0, 1e1, 1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+    1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15};
+constexpr int64_t kTickLimit = int64_t(1) << 53;
+
+struct TickScale {
+  int8_t exponent{TickBlockHeader::kRaw};
+  uint64_t step{1};
+};
+
+inline bool exactAt(const double v, const int e) {
+  const double scaled = v * kPow10[e];
+  return std::abs(scaled) < kTickLimit &&
+         double(std::llround(scaled)) / kPow10[e] == v;
+}
+
+// The coarsest tick representing all `values`; exactness only gets easier
+// with more digits, so one pass raising the exponent is enough.
+inline TickScale chooseScale(const std::vector<double>& values,
+                             const bool allowNegative) {
+  TickScale scale;
+  int e = 0;
+  for (const double v : values) {
+    if (!allowNegative && v < 0.) {
+      return scale;
+    }
+    while (e <= kMaxExponent && !exactAt(v, e)) {
+      ++e;
+    }
+    if (e > kMaxExponent) {
+      return scale;
+    }
+  }
+  uint64_t step = 0;
+  for (const double v : values) {
+    step = std::gcd(step, uint64_t(std::abs(std::llround(v * kPow10[e]))));
+  }
+  scale.exponent = int8_t(e);
+  scale.step = step ? step : 1;
+  return scale;
+}
+
+}  // namespace detail
+
+// Builds a tick store from a stream of event log records (see
+// FtxEventLogConverter, which works on either), keeping one open block per
+// market; fills and orders are not stored. A block is written once its
+// market moves on to a later hour, the rest on close(). An orderbook update
+// joins its block at kL2End, so one left unfinished is dropped. Without
+// close() (a conversion that threw) the store stays marked unclosed, which
+// readers reject.
+class TickStoreWriter {
+ public:
+  static constexpr int64_t kBlockNs = int64_t(3600) * 1000000000;
+  static constexpr uint32_t kNone = UINT32_MAX;
+
+  explicit TickStoreWriter(const std::string& path)
+      : fd_(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)) {
+    if (fd_ < 0) {
+      throw std::runtime_error("failed to open " + path + ": " +
+                               std::strerror(errno));
+    }
+    const TickStoreHeader header{TickStoreHeader::kMagic,
+                                 TickStoreHeader::kVersion};
+    writeAll(&header, sizeof(header));
+    offset_ = sizeof(header);
+  }
+  TickStoreWriter(const TickStoreWriter&) = delete;
+  TickStoreWriter& operator=(const TickStoreWriter&) = delete;
+  ~TickStoreWriter() {
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+
+  uint32_t intern(const std::string_view name) {
+    auto it = ids_.find(name);
+    if (it != ids_.end()) {
+      return it->second;
+    }
+    if (name.size() > UINT16_MAX) {
+      throw std::invalid_argument("symbol name too long");
+    }
+    const auto id = uint32_t(names_.size());
+    ids_.emplace(name, id);
+    names_.emplace_back(name);
+    return id;
+  }
+
+  void write(const EventRecord& r) {
+    switch (r.type) {
+      case EventRecord::kL2Begin:
+        update_ = r.market;
+        updateNs_ = r.ns;
+        updateKind_ = (r.flags & EventRecord::kPartial) ? kTickPartial
+                                                        : kTickUpdate;
+        bids_.clear();
+        asks_.clear();
+        break;
+      case EventRecord::kLevel:
+        ((r.flags & EventRecord::kSell) ? asks_ : bids_)
+            .push_back({r.px, r.qty});
+        break;
+      case EventRecord::kL2End:
+        if (update_ == r.market) {
+          auto& b = open(update_, updateNs_);
+          b.kinds.push_back(updateKind_);
+          b.times.push_back(updateNs_);
+          b.counts.push_back(uint32_t(bids_.size()));
+          b.counts.push_back(uint32_t(asks_.size()));
+          for (const auto* side : {&bids_, &asks_}) {
+            for (const auto& [px, qty] : *side) {
+              b.px.push_back(px);
+              b.qty.push_back(qty);
+            }
+          }
+          update_ = kNone;
+        }
+        break;
+      case EventRecord::kTrade: {
+        auto& b = open(r.market, r.ns);
+        uint8_t kind = kTickTrade;
+        kind |= r.qty < 0. ? kTickSell : 0;
+        kind |= (r.flags & EventRecord::kLiquidation) ? kTickLiquidation : 0;
+        b.kinds.push_back(kind);
+        b.times.push_back(r.ns);
+        b.px.push_back(r.px);
+        b.qty.push_back(std::abs(r.qty));
+        break;
+      }
+      default:  // fills and orders, with their aux records
+        break;
+    }
+  }
+
+  // Writes the open blocks, index and names; the store is complete after.
+  void close() {
+    for (uint32_t market = 0; market < pending_.size(); ++market) {
+      if (!pending_[market].kinds.empty()) {
+        writeBlock(market, pending_[market]);
+      }
+    }
+    std::stable_sort(
+        index_.begin(), index_.end(),
+        [](const TickBlock& a, const TickBlock& b) { return a.hour < b.hour; });
+    TickStoreHeader header{TickStoreHeader::kMagic, TickStoreHeader::kVersion};
+    header.numBlocks = index_.size();
+    header.numSymbols = names_.size();
+    header.indexOffset = offset_;
+    writeAll(index_.data(), index_.size() * sizeof(TickBlock));
+    for (const auto& name : names_) {
+      const auto size = uint16_t(name.size());
+      writeAll(&size, sizeof(size));
+      writeAll(name.data(), name.size());
+    }
+    if (::pwrite(fd_, &header, sizeof(header), 0) != sizeof(header)) {
+      throw std::runtime_error("failed to write tick store header");
+    }
+    if (::close(std::exchange(fd_, -1)) != 0) {
+      throw std::runtime_error("failed to close tick store");
+    }
+  }
+
+  // Bytes of blocks written so far.
+  uint64_t size() const { return offset_; }
+
+ private:
+  struct Pending {
+    int64_t hour{0};
+    std::vector<uint8_t> kinds;
+    std::vector<int64_t> times;
+    std::vector<uint32_t> counts;
+    std::vector<double> px;  // levels (bids, then asks) and trades
+    std::vector<double> qty;
+
+    void clear() {
+      kinds.clear();
+      times.clear();
+      counts.clear();
+      px.clear();
+      qty.clear();
+    }
+  };
+
+  // The block of `market` taking an event at `ns`. Blocks only move forward,
+  // so a slightly late stamp stays in the block of its market.
+  Pending& open(const uint32_t market, const int64_t ns) {
+    if (market >= pending_.size()) {
+      pending_.resize(market + 1);
+    }
+    auto& b = pending_[market];
+    const int64_t hour = ns - ns % kBlockNs;
+    if (b.kinds.empty()) {
+      b.hour = hour;
+    } else if (hour > b.hour) {
+      writeBlock(market, b);
+      b.hour = hour;
+    }
+    return b;
+  }
+
+  void writeBlock(const uint32_t market, Pending& b) {
+    using detail::kPow10;
+    const auto pxScale = detail::chooseScale(b.px, true);
+    const auto qtyScale = detail::chooseScale(b.qty, false);
+    std::string columns[TickBlockHeader::kNumColumns];
+    columns[TickBlockHeader::kKinds].assign(b.kinds.begin(), b.kinds.end());
+
+    auto& times = columns[TickBlockHeader::kTimes];
+    int64_t prev = b.times.front();
+    int64_t delta = 0;
+    for (const auto t : b.times) {
+      putVarint(times, zigzag(t - prev - delta));
+      delta = t - prev;
+      prev = t;
+    }
+    for (const auto n : b.counts) {
+      putVarint(columns[TickBlockHeader::kCounts], n);
+    }
+
+    auto& prices = columns[TickBlockHeader::kPrices];
+    auto& sizes = columns[TickBlockHeader::kSizes];
+    const auto ticks = [](const double v, const detail::TickScale& s) {
+      return std::llround(v * kPow10[s.exponent]) / int64_t(s.step);
+    };
+    int64_t last[3] = {0, 0, 0};  // bids, asks, trades
+    const auto put = [&](const int series, const size_t i) {
+      if (pxScale.exponent == TickBlockHeader::kRaw) {
+        prices.append(reinterpret_cast<const char*>(&b.px[i]), sizeof(double));
+      } else {
+        const auto t = ticks(b.px[i], pxScale);
+        putVarint(prices, zigzag(t - last[series]));
+        last[series] = t;
+      }
+      if (qtyScale.exponent == TickBlockHeader::kRaw) {
+        sizes.append(reinterpret_cast<const char*>(&b.qty[i]), sizeof(double));
+      } else {
+        putVarint(sizes, uint64_t(ticks(b.qty[i], qtyScale)));
+      }
+    };
+    size_t level = 0;
+    size_t update = 0;
+    for (const auto kind : b.kinds) {
+      if ((kind & kTickTypeMask) == kTickTrade) {
+        put(2, level++);
+        continue;
+      }
+      for (int side = 0; side < 2; ++side) {
+        for (uint32_t j = 0; j < b.counts[2 * update + side]; ++j) {
+          put(side, level++);
+        }
+      }
+      ++update;
+    }
+
+    TickBlockHeader header{};
+    header.firstNs = b.times.front();
+    header.numEvents = uint32_t(b.kinds.size());
+    header.pxExponent = pxScale.exponent;
+    header.qtyExponent = qtyScale.exponent;
+    header.pxStep = pxScale.step;
+    header.qtyStep = qtyScale.step;
+    uint64_t size = sizeof(header);
+    for (int c = 0; c < TickBlockHeader::kNumColumns; ++c) {
+      if (columns[c].size() > UINT32_MAX) {
+        throw std::runtime_error("tick store block too large");
+      }
+      header.columns[c] = uint32_t(columns[c].size());
+      size += columns[c].size();
+    }
+    index_.push_back({market, header.numEvents, b.hour, header.firstNs,
+                      *std::max_element(b.times.begin(), b.times.end()),
+                      offset_, size});
+    writeAll(&header, sizeof(header));
+    for (const auto& column : columns) {
+      writeAll(column.data(), column.size());
+    }
+    offset_ += size;
+    b.clear();
+  }
+
+  void writeAll(const void* data, size_t size) {
+    const auto* p = static_cast<const char*>(data);
+    while (size) {
+      const ssize_t n = ::write(fd_, p, size);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw std::runtime_error(std::string("failed to write tick store: ") +
+                                 std::strerror(errno));
+      }
+      p += n;
+      size -= n;
+    }
+  }
+
+  int fd_;
+  uint64_t offset_{0};
+  std::map<std::string, uint32_t, std::less<>> ids_;
+  std::vector<std::string> names_;
+  std::vector<Pending> pending_;  // by symbol id
+  uint32_t update_{kNone};        // market of the update in progress
+  int64_t updateNs_{0};
+  uint8_t updateKind_{0};
+  std::vector<std::pair<Px, Qty>> bids_;
+  std::vector<std::pair<Px, Qty>> asks_;
+  std::vector<TickBlock> index_;
+};
+
+// Streaming decoder of one block. The current event's kind and time are
+// decoded ahead, so blocks of several markets can be merged by time before
+// their levels are decoded by pop().
+class TickBlockCursor {
+ public:
+  explicit TickBlockCursor(const std::string_view block) {
+    if (block.size() < sizeof(header_)) {
+      throw std::runtime_error("corrupt tick store block");
+    }
+    std::memcpy(&header_, block.data(), sizeof(header_));
+    const char* p = block.data() + sizeof(header_);
+    const char* end = block.data() + block.size();
+    for (int c = 0; c < TickBlockHeader::kNumColumns; ++c) {
+      if (header_.columns[c] > size_t(end - p)) {
+        throw std::runtime_error("corrupt tick store block");
+      }
+      pos_[c] = p;
+      p += header_.columns[c];
+      end_[c] = p;
+    }
+    if (header_.columns[TickBlockHeader::kKinds] != header_.numEvents ||
+        !validScale(header_.pxExponent) || !validScale(header_.qtyExponent)) {
+      throw std::runtime_error("corrupt tick store block");
+    }
+    pxUnit_ = unit(header_.pxExponent);
+    qtyUnit_ = unit(header_.qtyExponent);
+    ns_ = header_.firstNs;
+    load();
+  }
+
+  bool done() const { return done_; }
+  uint8_t kind() const { return kind_; }
+  bool isTrade() const { return (kind_ & kTickTypeMask) == kTickTrade; }
+  bool isPartial() const { return (kind_ & kTickTypeMask) == kTickPartial; }
+  int64_t ns() const { return ns_; }
+
+  // Decodes the current event and moves to the next one. Orderbook levels go
+  // to level(side, px, qty), a trade to trade(px, signed qty, liquidation).
+  template <typename L, typename T>
+  void pop(L&& level, T&& trade) {
+    if (isTrade()) {
+      const Px px = price(2);
+      const Qty qty = size();
+      trade(px, (kind_ & kTickSell) ? -qty : qty,
+            bool(kind_ & kTickLiquidation));
+    } else {
+      const auto bids = count();
+      const auto asks = count();
+      for (uint64_t i = 0; i < bids; ++i) {
+        const Px px = price(0);
+        level(Side::kBid, px, size());
+      }
+      for (uint64_t i = 0; i < asks; ++i) {
+        const Px px = price(1);
+        level(Side::kAsk, px, size());
+      }
+    }
+    load();
+  }
+
+ private:
+  static bool validScale(const int8_t e) {
+    return e == TickBlockHeader::kRaw ||
+           (e >= 0 && e <= detail::kMaxExponent);
+  }
+  static double unit(const int8_t e) {
+    return e == TickBlockHeader::kRaw ? 0. : detail::kPow10[e];
+  }
+
+  void load() {
+    if (read_ == header_.numEvents) {
+      done_ = true;
+      return;
+    }
+    ++read_;
+    kind_ = uint8_t(*pos_[TickBlockHeader::kKinds]++);
+    delta_ += unzigzag(varint(TickBlockHeader::kTimes));
+    ns_ += delta_;
+  }
+
+  uint64_t varint(const int c) { return getVarint(pos_[c], end_[c]); }
+  uint64_t count() { return varint(TickBlockHeader::kCounts); }
+
+  double raw(const int c) {
+    if (end_[c] - pos_[c] < ptrdiff_t(sizeof(double))) {
+      throw std::runtime_error("corrupt tick store block");
+    }
+    double v;
+    std::memcpy(&v, pos_[c], sizeof(v));
+    pos_[c] += sizeof(v);
+    return v;
+  }
+
+  Px price(const int series) {
+    if (header_.pxExponent == TickBlockHeader::kRaw) {
+      return raw(TickBlockHeader::kPrices);
+    }
+    last_[series] += unzigzag(varint(TickBlockHeader::kPrices));
+    return double(last_[series] * int64_t(header_.pxStep)) / pxUnit_;
+  }
+  Qty size() {
+    if (header_.qtyExponent == TickBlockHeader::kRaw) {
+      return raw(TickBlockHeader::kSizes);
+    }
+    return double(varint(TickBlockHeader::kSizes) * header_.qtyStep) /
+           qtyUnit_;
+  }
+
+  TickBlockHeader header_;
+  const char* pos_[TickBlockHeader::kNumColumns];
+  const char* end_[TickBlockHeader::kNumColumns];
+  double pxUnit_;
+  double qtyUnit_;
+  uint32_t read_{0};
+  bool done_{false};
+  uint8_t kind_{0};
+  int64_t ns_;
+  int64_t delta_{0};
+  int64_t last_[3] = {0, 0, 0};  // bids, asks, trades
+};
+
+// Memory mapped tick store.
+class TickStoreReader {
+ public:
+  explicit TickStoreReader(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("failed to open " + path + ": " +
+                               std::strerror(errno));
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      ::close(fd);
+      throw std::runtime_error("failed to stat " + path);
+    }
+    size_ = st.st_size;
+    if (size_ < sizeof(TickStoreHeader)) {
+      ::close(fd);
+      throw std::runtime_error(path + " is not a tick store");
+    }
+    void* base = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+      throw std::runtime_error("failed to map " + path + ": " +
+                               std::strerror(errno));
+    }
+    data_ = static_cast<const char*>(base);
+    try {
+      load(path);
+    } catch (...) {
+      ::munmap(base, size_);
+      throw;
+    }
+  }
+  TickStoreReader(const TickStoreReader&) = delete;
+  TickStoreReader& operator=(const TickStoreReader&) = delete;
+  ~TickStoreReader() { ::munmap(const_cast<char*>(data_), size_); }
+
+  const std::vector<TickBlock>& blocks() const { return blocks_; }
+  std::string_view block(const TickBlock& b) const {
+    return {data_ + b.offset, b.size};
+  }
+  std::string_view symbol(const uint32_t id) const { return symbols_.at(id); }
+  size_t numSymbols() const { return symbols_.size(); }
+  size_t size() const { return size_; }
+
+ private:
+  void load(const std::string& path) {
+    TickStoreHeader header;
+    std::memcpy(&header, data_, sizeof(header));
+    if (header.magic != TickStoreHeader::kMagic ||
+        header.version != TickStoreHeader::kVersion) {
+      throw std::runtime_error(path + " is not a version " +
+                               std::to_string(TickStoreHeader::kVersion) +
+                               " tick store");
+    }
+    if (header.indexOffset == 0) {
+      throw std::runtime_error(path + " was not closed");
+    }
+    const auto corrupt = [&path] {
+      return std::runtime_error(path + ": corrupt tick store index");
+    };
+    if (header.indexOffset > size_ ||
+        header.numBlocks > (size_ - header.indexOffset) / sizeof(TickBlock)) {
+      throw corrupt();
+    }
+    blocks_.resize(header.numBlocks);
+    std::memcpy(blocks_.data(), data_ + header.indexOffset,
+                blocks_.size() * sizeof(TickBlock));
+    const char* p = data_ + header.indexOffset +
+                    blocks_.size() * sizeof(TickBlock);
+    const char* end = data_ + size_;
+    for (uint64_t i = 0; i < header.numSymbols; ++i) {
+      uint16_t n;
+      if (end - p < ptrdiff_t(sizeof(n))) {
+        throw corrupt();
+      }
+      std::memcpy(&n, p, sizeof(n));
+      p += sizeof(n);
+      if (end - p < n) {
+        throw corrupt();
+      }
+      symbols_.emplace_back(p, n);
+      p += n;
+    }
+    for (const auto& b : blocks_) {
+      if (b.market >= symbols_.size() || b.offset > header.indexOffset ||
+          b.size > header.indexOffset - b.offset) {
+        throw corrupt();
+      }
+    }
+  }
+
+  const char* data_{nullptr};
+  size_t size_{0};
+  std::vector<TickBlock> blocks_;
+  std::vector<std::string_view> symbols_;
+};
+
+}  // namespace ngh::io
@@ -0,0 +1,471 @@
+#pragma once
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "ngh/types/types.h"
+#include "simdjson.h"
+
+namespace ngh::io {
+
+// What a read-ahead source spent waiting on the disk.
+struct ReadStats {
+  uint64_t bytes{0};
+  uint64_t blocks{0};
+  uint64_t stalls{0};       // blocks the parser had to wait for
+  double stallSeconds{0.};  // time spent in those waits
+  bool uring{false};        // false when reads fell back to pread
+};
+
+namespace detail {
+
+// Just enough io_uring for reads, over the raw syscalls (no liburing): one
+// submission and one completion ring, mapped as the kernel lays them out.
+class Uring {
+ public:
+  // nullptr when the kernel has no (or forbids) io_uring, or can't read
+  // through it: IORING_OP_READ came with the probe in 5.6, so 5.1 to 5.5
+  // fail the probe as well.
+  static std::unique_ptr<Uring> create(const unsigned entries) {
+    io_uring_params p{};
+    const int fd = int(::syscall(__NR_io_uring_setup, entries, &p));
+    if (fd < 0) {
+      return nullptr;
+    }
+    auto ring = std::unique_ptr<Uring>(new Uring(fd));
+    return ring->map(p) && ring->supports(IORING_OP_READ) ? std::move(ring)
+                                                          : nullptr;
+  }
+  Uring(const Uring&) = delete;
+  Uring& operator=(const Uring&) = delete;
+  ~Uring() {
+    if (sqes_) {
+      ::munmap(sqes_, sqesSize_);
+    }
+    if (cq_ && cq_ != sq_) {
+      ::munmap(cq_, cqSize_);
+    }
+    if (sq_) {
+      ::munmap(sq_, sqSize_);
+    }
+    ::close(fd_);
+  }
+
+  // False if the kernel can't tell, i.e. before 5.6.
+  bool supports(const unsigned op) const {
+    constexpr unsigned kOps = 256;
+    alignas(io_uring_probe) char buf[sizeof(io_uring_probe) +
+                                     kOps * sizeof(io_uring_probe_op)]{};
+    auto* probe = reinterpret_cast<io_uring_probe*>(buf);
+    if (::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE, probe,
+                  kOps) != 0) {
+      return false;
+    }
+    return op <= probe->last_op && op < probe->ops_len &&
+           (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+  }
+
+  // Fixed buffers spare the kernel mapping pages per read; this fails when
+  // RLIMIT_MEMLOCK is too low, and plain reads are used then.
+  bool registerBuffers(const std::vector<iovec>& iovs) {
+    return ::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_BUFFERS,
+                     iovs.data(), unsigned(iovs.size())) == 0;
+  }
+
+  // Queues a read of `len` bytes at `offset` into `buf`, registered buffer
+  // `index` if not negative; submit() passes queued reads to the kernel.
+  void read(const int fd, void* buf, const unsigned len, const uint64_t offset,
+            const int index, const uint64_t data) {
+    const unsigned tail = *sqTail_;
+    auto& sqe = sqes_[tail & sqMask_];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = index < 0 ? IORING_OP_READ : IORING_OP_READ_FIXED;
+    sqe.fd = fd;
+    sqe.addr = reinterpret_cast<uint64_t>(buf);
+    sqe.len = len;
+    sqe.off = offset;
+    sqe.buf_index = uint16_t(std::max(index, 0));
+    sqe.user_data = data;
+    sqArray_[tail & sqMask_] = tail & sqMask_;
+    __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+    ++queued_;
+  }
+
+  // Passes queued reads and, if `wait`, blocks until a completion is ready.
+  void submit(bool wait = false) {
+    for (;;) {
+      const long n =
+          ::syscall(__NR_io_uring_enter, fd_, queued_, wait ? 1 : 0,
+                    wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+      if (n >= 0) {
+        queued_ -= unsigned(n);
+        if (!queued_) {
+          return;
+        }
+        wait = false;  // completions are in, only submissions remain
+      } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        throw std::runtime_error(std::string("io_uring_enter failed: ") +
+                                 std::strerror(errno));
+      }
+    }
+  }
+
+  // Pops a completion if one is ready.
+  bool complete(io_uring_cqe& out) {
+    const unsigned head = *cqHead_;
+    if (head == __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) {
+      return false;
+    }
+    out = cqes_[head & cqMask_];
+    __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+ private:
+  explicit Uring(const int fd) : fd_(fd) {}
+
+  bool map(const io_uring_params& p) {
+    sqSize_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cqSize_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    const bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) {
+      sqSize_ = cqSize_ = std::max(sqSize_, cqSize_);
+    }
+    sq_ = mapRing(sqSize_, IORING_OFF_SQ_RING);
+    cq_ = single ? sq_ : mapRing(cqSize_, IORING_OFF_CQ_RING);
+    sqesSize_ = p.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(mapRing(sqesSize_, IORING_OFF_SQES));
+    if (!sq_ || !cq_ || !sqes_) {
+      return false;
+    }
+    auto* sq = static_cast<char*>(sq_);
+    auto* cq = static_cast<char*>(cq_);
+    sqTail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    cqHead_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+    return true;
+  }
+
+  void* mapRing(const size_t size, const off_t offset) const {
+    void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd_, offset);
+    return p == MAP_FAILED ? nullptr : p;
+  }
+
+  int fd_;
+  void* sq_{nullptr};
+  void* cq_{nullptr};
+  io_uring_sqe* sqes_{nullptr};
+  size_t sqSize_{0};
+  size_t cqSize_{0};
+  size_t sqesSize_{0};
+  unsigned* sqTail_{nullptr};
+  unsigned sqMask_{0};
+  unsigned* sqArray_{nullptr};
+  unsigned* cqHead_{nullptr};
+  unsigned* cqTail_{nullptr};
+  unsigned cqMask_{0};
+  io_uring_cqe* cqes_{nullptr};
+  unsigned queued_{0};
+};
+
+}  // namespace detail
+
+// Line source reading an uncompressed file in large blocks with `depth` of
+// them in flight through io_uring, so parsing overlaps the disk even where
+// the page cache is cold (a fresh NVMe or network volume), unlike mmap
+// faults which are served one at a time. Buffers are registered with the
+// ring when the memlock limit allows. Without io_uring (kernels before 5.6,
+// seccomp) blocks are read with pread when needed, as are blocks the ring
+// refuses to read (EINVAL).
+//
+// Lines are views into the block buffers, or into a copy for lines crossing
+// a block boundary, followed by SIMDJSON_PADDING readable bytes; they are
+// valid until the following next(). stats() tells how long the parsing
+// thread waited for blocks.
+class UringLineReader {
+ public:
+  static constexpr size_t kDefaultBlock = 4 << 20;
+  static constexpr unsigned kDefaultDepth = 4;
+
+  explicit UringLineReader(const std::string& path,
+                           const size_t blockSize = kDefaultBlock,
+                           const unsigned depth = kDefaultDepth)
+      : blockSize_(blockSize), depth_(depth) {
+    if (blockSize == 0 || blockSize > UINT32_MAX || depth == 0) {
+      throw std::invalid_argument("block size and depth must be positive");
+    }
+    fd_ = ::open(path.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+      throw std::runtime_error("failed to open " + path + ": " +
+                               std::strerror(errno));
+    }
+    struct stat st;
+    if (::fstat(fd_, &st) != 0) {
+      ::close(fd_);
+      throw std::runtime_error("failed to stat " + path);
+    }
+    size_ = st.st_size;
+    numBlocks_ = (size_ + blockSize_ - 1) / blockSize_;
+    ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    const size_t page = ::sysconf(_SC_PAGESIZE);
+    stride_ = (blockSize_ + simdjson::SIMDJSON_PADDING + page - 1) / page *
+              page;
+    buffers_.reset(
+        static_cast<char*>(std::aligned_alloc(page, stride_ * depth_)));
+    if (!buffers_) {
+      ::close(fd_);
+      throw std::bad_alloc();
+    }
+    std::memset(buffers_.get(), 0, stride_ * depth_);
+    slots_.resize(depth_);
+
+    ring_ = detail::Uring::create(depth_);
+    if (ring_) {
+      std::vector<iovec> iovs(depth_);
+      for (unsigned i = 0; i < depth_; ++i) {
+        iovs[i] = {buffers_.get() + i * stride_, blockSize_};
+      }
+      fixed_ = ring_->registerBuffers(iovs);
+      stats_.uring = true;
+      for (size_t b = 0; b < std::min<size_t>(depth_, numBlocks_); ++b) {
+        request(b);
+      }
+      ring_->submit();
+    }
+  }
+  UringLineReader(const UringLineReader&) = delete;
+  UringLineReader& operator=(const UringLineReader&) = delete;
+  ~UringLineReader() {
+    if (ring_) {  // buffers must outlive reads still in flight
+      io_uring_cqe cqe;
+      for (unsigned inflight = pending(); inflight;) {
+        while (ring_->complete(cqe)) {
+          --inflight;
+        }
+        if (inflight) {
+          try {
+            ring_->submit(true);
+          } catch (const std::exception&) {
+            break;
+          }
+        }
+      }
+      ring_.reset();
+    }
+    ::close(fd_);
+  }
+
+  // Skips empty lines; returns false once the file is exhausted.
+  bool next(std::string_view& line) {
+    if (carried_) {
+      carry_.clear();
+      carried_ = false;
+    }
+    for (;;) {
+      while (pos_ < end_) {
+        const auto* nl =
+            static_cast<const char*>(std::memchr(pos_, '\n', end_ - pos_));
+        if (!nl) {
+          carry_.append(pos_, end_);
+          pos_ = end_;
+          break;
+        }
+        const char* begin = pos_;
+        pos_ = nl + 1;
+        if (!carry_.empty()) {
+          carry_.append(begin, nl);
+          return takeCarry(line);
+        }
+        if (nl != begin) {
+          line = {begin, size_t(nl - begin)};
+          return true;
+        }
+      }
+      if (block_ + 1 >= numBlocks_) {
+        block_ = numBlocks_;
+        return !carry_.empty() && takeCarry(line);
+      }
+      if (block_ != kNone) {
+        recycle(block_);  // the previous line is no longer in use
+      }
+      acquire(++block_);
+    }
+  }
+
+  const ReadStats& stats() const { return stats_; }
+  size_t size() const { return size_; }
+
+ private:
+  static constexpr size_t kNone = SIZE_MAX;
+
+  struct Slot {
+    size_t block{kNone};
+    bool ready{false};
+    int result{0};
+  };
+  struct Free {
+    void operator()(char* p) const { std::free(p); }
+  };
+
+  char* buffer(const size_t block) const {
+    return buffers_.get() + (block % depth_) * stride_;
+  }
+  size_t length(const size_t block) const {
+    return std::min(blockSize_, size_ - block * blockSize_);
+  }
+
+  bool takeCarry(std::string_view& line) {
+    carry_.reserve(carry_.size() + simdjson::SIMDJSON_PADDING);
+    line = carry_;
+    carried_ = true;
+    return true;
+  }
+
+  unsigned pending() const {
+    unsigned n = 0;
+    for (const auto& s : slots_) {
+      n += s.block != kNone && !s.ready;
+    }
+    return n;
+  }
+
+  void request(const size_t block) {
+    auto& slot = slots_[block % depth_];
+    slot = {block, false, 0};
+    ring_->read(fd_, buffer(block), unsigned(length(block)),
+                block * blockSize_, fixed_ ? int(block % depth_) : -1, block);
+  }
+
+  // Makes `block` the current one, waiting for its read if needed.
+  void acquire(const size_t block) {
+    char* buf = buffer(block);
+    const size_t len = length(block);
+    size_t got = 0;
+    if (ring_) {
+      auto& slot = slots_[block % depth_];
+      reap();
+      if (!slot.ready) {
+        const auto t0 = SteadyClock::now();
+        while (!slot.ready) {
+          ring_->submit(true);
+          reap();
+        }
+        stall(t0);
+      }
+      if (slot.result == -EINVAL || slot.result == -EOPNOTSUPP) {
+        got = 0;  // not readable through the ring after all, pread below
+      } else if (slot.result < 0) {
+        throw std::runtime_error(std::string("read failed: ") +
+                                 std::strerror(-slot.result));
+      } else {
+        got = size_t(slot.result);
+      }
+    } else {
+      const auto t0 = SteadyClock::now();
+      got = readAt(buf, len, block * blockSize_);
+      stall(t0);
+    }
+    if (got < len) {  // short or refused read, finish it in place
+      got += readAt(buf + got, len - got, block * blockSize_ + got);
+    }
+    if (got < len) {
+      throw std::runtime_error("file shrank while reading");
+    }
+    std::memset(buf + len, 0, simdjson::SIMDJSON_PADDING);
+    pos_ = buf;
+    end_ = buf + len;
+    stats_.bytes += len;
+    ++stats_.blocks;
+  }
+
+  // Hands the slot of a consumed block to the read `depth` blocks ahead.
+  void recycle(const size_t block) {
+    slots_[block % depth_].block = kNone;
+    if (ring_ && block + depth_ < numBlocks_) {
+      request(block + depth_);
+      ring_->submit();
+    }
+  }
+
+  void reap() {
+    io_uring_cqe cqe;
+    while (ring_->complete(cqe)) {
+      auto& slot = slots_[cqe.user_data % depth_];
+      if (slot.block == cqe.user_data) {
+        slot.ready = true;
+        slot.result = cqe.res;
+      }
+    }
+  }
+
+  void stall(const SteadyTime t0) {
+    ++stats_.stalls;
+    stats_.stallSeconds +=
+        std::chrono::duration<double>(SteadyClock::now() - t0).count();
+  }
+
+  size_t readAt(char* buf, size_t len, uint64_t offset) {
+    size_t got = 0;
+    while (len) {
+      const ssize_t n = ::pread(fd_, buf, len, offset);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n < 0) {
+        throw std::runtime_error(std::string("read failed: ") +
+                                 std::strerror(errno));
+      }
+      if (n == 0) {
+        break;
+      }
+      buf += n;
+      len -= n;
+      offset += n;
+      got += n;
+    }
+    return got;
+  }
+
+  size_t blockSize_;
+  unsigned depth_;
+  int fd_{-1};
+  size_t size_{0};
+  size_t numBlocks_{0};
+  size_t stride_{0};
+  std::unique_ptr<char, Free> buffers_;
+  std::vector<Slot> slots_;
+  std::unique_ptr<detail::Uring> ring_;
+  bool fixed_{false};
+
+  size_t block_{kNone};
+  const char* pos_{nullptr};
+  const char* end_{nullptr};
+  std::string carry_;
+  bool carried_{false};
+  ReadStats stats_;
+};
+
+}  // namespace ngh::io
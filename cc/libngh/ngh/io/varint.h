@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+namespace ngh::io {
+
+// LEB128 varints: 7 bits per byte, low groups first, high bit set on all but
+// the last byte. Signed values go through zigzag so small magnitudes of
+// either sign stay short.
+
+constexpr uint64_t zigzag(const int64_t v) {
+  return (uint64_t(v) << 1) ^ uint64_t(v >> 63);
+}
+constexpr int64_t unzigzag(const uint64_t v) {
+  return int64_t(v >> 1) ^ -int64_t(v & 1);
+}
+
+inline void putVarint(std::string& out, uint64_t v) {
+  while (v >= 0x80) {
+    out.push_back(char(v | 0x80));
+    v >>= 7;
+  }
+  out.push_back(char(v));
+}
+
+// Advances `p`, which must stay below `end`.
+inline uint64_t getVarint(const char*& p, const char* end) {
+  uint64_t v = 0;
+  for (int shift = 0; shift < 64 && p < end; shift += 7) {
+    const auto b = uint8_t(*p++);
+    v |= uint64_t(b & 0x7f) << shift;
+    if (b < 0x80) {
+      return v;
+    }
+  }
+  throw std::runtime_error("truncated varint");
+}
+
+}  // namespace ngh::io
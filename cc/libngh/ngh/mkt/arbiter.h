@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+
+#include "ngh/io/scan.h"
+#include "ngh/types/types.h"
+
+namespace ngh::mkt {
+
+// First-arrival-wins arbitration of redundant (A/B) feeds: accept() is true
+// for the first copy of a message and false for copies seen within `window`
+// of it, so the effective latency is the minimum over the connections.
+//
+// Messages are fingerprinted by market, channel and a hash of their "data"
+// (which holds the exchange time), found with the cheap scanners. Control
+// messages without data (subscribed, pong, ...) are always accepted.
+// Fingerprints expire in arrival order, so the set stays as small as one
+// window of traffic and both insert and expiry are O(1).
+class FeedArbiter {
+ public:
+  explicit FeedArbiter(const Duration window, const size_t expected = 1 << 14)
+      : window_(window) {
+    seen_.reserve(expected);
+  }
+
+  static uint64_t fingerprint(const std::string_view msg) {
+    const auto data = msg.find("\"data\"");
+    if (data == std::string_view::npos) {
+      return 0;
+    }
+    const std::hash<std::string_view> hash;
+    uint64_t h = hash(msg.substr(data));
+    h ^= hash(io::scanString(msg.substr(0, data), "market")) +
+         0x9e3779b97f4a7c15 + (h << 6) + (h >> 2);
+    h ^= hash(io::scanString(msg.substr(0, data), "channel")) +
+         0x9e3779b97f4a7c15 + (h << 6) + (h >> 2);
+    return h | 1;  // 0 is for control messages
+  }
+
+  bool accept(const std::string_view msg,
+              const SteadyTime now = SteadyClock::now()) {
+    const auto fp = fingerprint(msg);
+    if (fp == 0) {
+      ++forwarded_;
+      return true;
+    }
+    while (!arrivals_.empty() && now - arrivals_.front().first > window_) {
+      seen_.erase(arrivals_.front().second);
+      arrivals_.pop_front();
+    }
+    if (!seen_.insert(fp).second) {
+      ++dropped_;
+      return false;
+    }
+    arrivals_.emplace_back(now, fp);
+    ++forwarded_;
+    return true;
+  }
+
+  uint64_t forwarded() const { return forwarded_; }
+  uint64_t dropped() const { return dropped_; }
+  size_t size() const { return seen_.size(); }
+
+ private:
+  Duration window_;
+  std::unordered_set<uint64_t> seen_;
+  std::deque<std::pair<SteadyTime, uint64_t>> arrivals_;
+  uint64_t forwarded_{0};
+  uint64_t dropped_{0};
+};
+
+}  // namespace ngh::mkt
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ngh/mkt/ftxhandler.h"
+#include "ngh/mkt/replay.h"
+#include "ngh/mkt/sampler.h"
+#include "ngh/types/types.h"
+
+namespace ngh::mkt {
+
+// Per capture outcome of replayBatch().
+struct BatchStats {
+  uint64_t lines;
+  uint64_t markets;  // distinct markets seen
+  double lastTs;     // last orderbook event time
+  double seconds;    // wall time spent on the capture
+};
+
+// Replays one capture per entry of `paths` on `threads` workers (all cores
+// when 0). Captures are handed out in order as workers free up; each worker
+// owns an FtxHandler, and so a parser, reset between captures. Capture i
+// samples `markets` at starts[i] + k * interval for k < rows into
+// out[i] ([rows, market, level, field], see BookSampler) and fills stats[i].
+//
+// Workers write disjoint slices of the caller's buffers and share nothing
+// else. The first failure stops the batch and is rethrown once all workers
+// are done.
+template <typename Source>
+void replayBatch(const std::vector<std::string>& paths,
+                 const std::vector<std::string>& markets, const size_t depth,
+                 const std::span<const double> starts, const double interval,
+                 const size_t rows, float* out, BatchStats* stats,
+                 size_t threads = 0) {
+  if (starts.size() != paths.size()) {
+    throw std::invalid_argument("one start per capture is required");
+  }
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  const size_t daySize =
+      rows * markets.size() * depth * BookSampler::kNumFields;
+  std::atomic<size_t> next{0};
+  std::atomic<bool> failed{false};
+  std::exception_ptr error;
+  std::mutex errorMutex;
+
+  const auto work = [&] {
+    auto handler = std::make_unique<FtxHandler>();
+    for (size_t i = next++; i < paths.size() && !failed; i = next++) {
+      try {
+        const auto t0 = SteadyClock::now();
+        handler->reset();
+        std::vector<double> grid(rows);
+        for (size_t k = 0; k < rows; ++k) {
+          grid[k] = starts[i] + interval * k;
+        }
+        auto& sampler = handler->attachSampler(markets, depth, std::move(grid),
+                                               out + i * daySize);
+        Source source(paths[i]);
+        const auto lines = replayAll(source, *handler);
+        sampler.flush();
+        handler->detachSampler();
+        stats[i] = {lines, handler->getMarkets().size(), handler->lastTs,
+                    std::chrono::duration<double>(SteadyClock::now() - t0)
+                        .count()};
+      } catch (...) {
+        std::lock_guard lock(errorMutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+        failed = true;
+      }
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < std::min(threads, paths.size()); ++i) {
+    workers.emplace_back(work);
+  }
+  work();  // the calling thread is a worker too
+  for (auto& w : workers) {
+    w.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+}  // namespace ngh::mkt
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ngh/io/file.h"
+#include "ngh/io/mmapreader.h"
+#include "ngh/io/scan.h"
+#include "ngh/mkt/ftxstate.h"
+
+namespace ngh::mkt {
+
+// Sparse time index of an uncompressed capture file, kept next to it as
+// "<capture>.idx". It maps orderbook event time, on an `interval` second
+// grid, to the offset of the first line at or past each grid point, and
+// lists the offset of every "partial" snapshot per market. Together they
+// give the shortest stretch of the capture that rebuilds chosen books as of
+// any time, see seekRange().
+struct CaptureIndex {
+  static constexpr uint32_t kMagic = 0x58444e49;  // "INDX"
+  static constexpr uint32_t kVersion = 1;
+
+  struct Entry {
+    double ts;
+    uint64_t offset;
+  };
+
+  double interval{0.};
+  io::FileStamp capture{};   // the index is stale if this changed
+  std::vector<Entry> times;  // grid time, first line at or past it
+  std::map<std::string, std::vector<Entry>, std::less<>> partials;
+
+  static std::string sidecar(const std::string& capture) {
+    return capture + ".idx";
+  }
+
+  // One pass over `capture` with the cheap scanners, no json parsing.
+  static CaptureIndex build(const std::string& capture, const double interval) {
+    if (!(interval > 0.)) {
+      throw std::invalid_argument("index interval must be positive");
+    }
+    if (capture.ends_with(".gz")) {
+      throw std::invalid_argument("cannot index a compressed capture");
+    }
+    CaptureIndex index;
+    index.interval = interval;
+    // stamped first, so a capture written to while indexed reads as stale
+    index.capture = io::fileStamp(capture);
+    io::MmapLineReader reader(capture);
+    double next = -INFINITY;
+    std::string_view line;
+    for (size_t offset = 0; reader.next(line); offset = reader.tell()) {
+      const double t = io::scanTime(line);
+      if (std::isnan(t)) {
+        continue;
+      }
+      if (t >= next) {
+        const double g = std::floor(t / interval) * interval;
+        index.times.push_back({g, offset});
+        next = g + interval;
+      }
+      if (io::scanString(line, "type") == "partial") {
+        const auto market = io::scanString(line, "market");
+        auto it = index.partials.find(market);
+        if (it == index.partials.end()) {
+          it = index.partials.emplace(market, std::vector<Entry>{}).first;
+        }
+        it->second.push_back({t, offset});
+      }
+    }
+    return index;
+  }
+
+  // The sidecar of `capture` if it is current, otherwise a fresh index
+  // (saved as the new sidecar when `save`). A sidecar is current if it has
+  // this version and `interval`, and the capture's size and mtime have not
+  // changed since it was built.
+  static CaptureIndex open(const std::string& capture, const double interval,
+                           const bool save = true) {
+    const auto path = sidecar(capture);
+    if (io::fileExists(path)) {
+      CaptureIndex index;
+      if (parse(io::readFile(path), index) &&
+          index.interval == interval &&
+          index.capture == io::fileStamp(capture)) {
+        return index;
+      }
+    }
+    auto index = build(capture, interval);
+    if (save) {
+      index.save(path);
+    }
+    return index;
+  }
+
+  void save(const std::string& path) const {
+    std::string out;
+    state::Writer w(out);
+    w.put(kMagic);
+    w.put(kVersion);
+    w.put(interval);
+    w.put(capture.size);
+    w.put(capture.mtimeNs);
+    w.put(uint64_t(times.size()));
+    out.append(reinterpret_cast<const char*>(times.data()),
+               times.size() * sizeof(Entry));
+    w.put(uint32_t(partials.size()));
+    for (const auto& [market, entries] : partials) {
+      w.putStr(market);
+      w.put(uint64_t(entries.size()));
+      out.append(reinterpret_cast<const char*>(entries.data()),
+                 entries.size() * sizeof(Entry));
+    }
+    io::writeFile(path, out);
+  }
+
+  static CaptureIndex load(const std::string& path) {
+    CaptureIndex index;
+    if (!parse(io::readFile(path), index)) {
+      throw std::runtime_error(path + " is not a capture index of version " +
+                               std::to_string(kVersion));
+    }
+    return index;
+  }
+
+  // Lines in [from, to) rebuild the books of `markets` (all indexed markets
+  // when empty) from their latest partial at or before `ts`; the lines from
+  // `to` on need a time check against `ts` (within one interval). Markets
+  // without such a partial have no book at `ts` and are ignored.
+  std::pair<size_t, size_t> seekRange(
+      const double ts, const std::vector<std::string>& markets) const {
+    const auto last = [ts](const std::vector<Entry>& entries) {
+      auto it = std::upper_bound(
+          entries.begin(), entries.end(), ts,
+          [](const double t, const Entry& e) { return t < e.ts; });
+      return it == entries.begin() ? nullptr : &*(it - 1);
+    };
+    const auto* grid = last(times);
+    const size_t to = grid ? grid->offset : 0;
+    size_t from = to;
+    const auto visit = [&](const std::vector<Entry>& entries) {
+      if (const auto* p = last(entries)) {
+        from = std::min<size_t>(from, p->offset);
+      }
+    };
+    if (markets.empty()) {
+      for (const auto& [market, entries] : partials) {
+        visit(entries);
+      }
+    } else {
+      for (const auto& market : markets) {
+        if (auto it = partials.find(market); it != partials.end()) {
+          visit(it->second);
+        }
+      }
+    }
+    return {from, to};
+  }
+
+ private:
+  // False if `in` is not an index of this version; throws if truncated.
+  static bool parse(const std::string_view in, CaptureIndex& index) {
+    state::Reader r(in, "truncated capture index");
+    if (r.get<uint32_t>() != kMagic || r.get<uint32_t>() != kVersion) {
+      return false;
+    }
+    index.interval = r.get<double>();
+    index.capture.size = r.get<uint64_t>();
+    index.capture.mtimeNs = r.get<int64_t>();
+    const auto getEntries = [&r](std::vector<Entry>& entries) {
+      entries.resize(r.get<uint64_t>());
+      for (auto& e : entries) {
+        e = r.get<Entry>();
+      }
+    };
+    getEntries(index.times);
+    const auto n = r.get<uint32_t>();
+    for (uint32_t i = 0; i < n; ++i) {
+      const auto market = r.str();
+      getEntries(index.partials[std::string(market)]);
+    }
+    return true;
+  }
+};
+
+}  // namespace ngh::mkt
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <functional>
+#include <span>
+#include <vector>
+
+#include "ngh/types/types.h"
+
+namespace ngh::mkt {
+
+enum class EventType : uint8_t {
+  kBook = 0,  // book changed, coalesced to one per market per batch
+  kTrade = 1,
+  kFill = 2,
+  kOrder = 3,
+};
+
+// Flat record for every event type, so a batch is one array (and one numpy
+// structured dtype, hence the raw type and side bytes). Fields that do not
+// apply to a type are NaN / zero.
+struct Event {
+  enum Flags : uint8_t {
+    kLiquidation = 1,  // trade
+    kClosed = 2,       // order
+  };
+
+  double ts;
+  OID id;  // order id for fills and orders
+  Px px;
+  Qty qty;  // signed for trades and fills, remaining size for orders
+  MarketId market;
+  uint8_t type;  // EventType
+  uint8_t side;  // Side
+  uint8_t flags;
+};
+
+// Buffers handler events and hands them to `sink` in batches of
+// `maxEvents`. The batcher has no clock: whoever applies messages calls
+// flush() once it runs out of them, as Feed and Ingest do after every read.
+class EventBatcher {
+ public:
+  using Sink = std::function<void(std::span<const Event>)>;
+
+  EventBatcher(Sink sink, const size_t maxEvents)
+      : sink_(std::move(sink)), maxEvents_(maxEvents) {
+    events_.reserve(maxEvents);
+  }
+
+  void onBook(const MarketId market, const double ts) {
+    if (market >= bookSlot_.size()) {
+      bookSlot_.resize(market + 1, kNoSlot);
+    }
+    if (bookSlot_[market] != kNoSlot) {
+      events_[bookSlot_[market]].ts = ts;
+      return;
+    }
+    bookSlot_[market] = events_.size();
+    push(Event{ts, 0, NAN, NAN, market, uint8_t(EventType::kBook),
+               uint8_t(Side::kBuy), 0});
+  }
+  void onTrade(const MarketId market, const double ts, const Px px,
+               const Qty qty, const bool liquidation) {
+    push(Event{ts, 0, px, qty, market, uint8_t(EventType::kTrade),
+               uint8_t(qty < 0 ? Side::kSell : Side::kBuy),
+               uint8_t(liquidation ? Event::kLiquidation : 0)});
+  }
+  void onFill(const MarketId market, const double ts, const OID id,
+              const Px px, const Qty qty) {
+    push(Event{ts, id, px, qty, market, uint8_t(EventType::kFill),
+               uint8_t(qty < 0 ? Side::kSell : Side::kBuy), 0});
+  }
+  void onOrder(const MarketId market, const double ts, const Order& o) {
+    const bool closed = o.status == "closed";
+    push(Event{ts, o.id, o.price, o.remainingSize, market,
+               uint8_t(EventType::kOrder),
+               uint8_t(o.side == "sell" ? Side::kSell : Side::kBuy),
+               uint8_t(closed ? Event::kClosed : 0)});
+  }
+
+  void flush() {
+    if (events_.empty()) {
+      return;
+    }
+    for (const auto& e : events_) {
+      if (e.type == uint8_t(EventType::kBook)) {
+        bookSlot_[e.market] = kNoSlot;
+      }
+    }
+    struct Clear {
+      std::vector<Event>& events;
+      ~Clear() { events.clear(); }
+    } clear{events_};
+    sink_(events_);
+  }
+
+  size_t pending() const { return events_.size(); }
+
+ private:
+  static constexpr size_t kNoSlot = -1;
+
+  void push(const Event& e) {
+    events_.push_back(e);
+    if (events_.size() >= maxEvents_) {
+      flush();
+    }
+  }
+
+  Sink sink_;
+  size_t maxEvents_;
+  std::vector<Event> events_;
+  std::vector<size_t> bookSlot_;  // pending book event per market
+};
+
+}  // namespace ngh::mkt
@@ -0,0 +1,293 @@
+#pragma once
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ngh/mkt/ingest.h"
+#include "ngh/net/websocket.h"
+#include "ngh/types/types.h"
+#include "ngh/util/cpu.h"
+
+namespace ngh::mkt {
+
+struct FeedConfig {
+  Duration pingInterval{std::chrono::seconds(15)};  // 0 disables pings
+  // Spin on non-blocking reads instead of sleeping in epoll_wait: no wake-up
+  // latency, at the cost of a whole cpu, best an isolated one (isolcpus=).
+  bool busyPoll{false};
+  int cpu{-1};        // pin the thread to this cpu when >= 0
+  int busyPollUs{0};  // SO_BUSY_POLL on the socket when > 0
+};
+
+// Where the feed thread's time goes, comparable between the two modes: idle
+// is waiting for data (in epoll_wait, or reads that found nothing), busy is
+// decoding and applying it.
+struct FeedStats {
+  uint64_t polls{0};  // socket reads (busy poll) or wake-ups (epoll)
+  uint64_t emptyPolls{0};
+  double busySeconds{0.};
+  double idleSeconds{0.};
+  bool isolated{false};  // pinned to a cpu listed in isolcpus=
+};
+
+// Live websocket feed applied on its own thread, without Python in the
+// loop: an epoll loop reads the socket, decodes frames in place and hands
+// each message straight to the handler (through its FeedArbiter, if any),
+// then publishes changed tops through a TopPublisher like IngestThread.
+//
+// Messages longer than the handler takes (Handler::kMaxMessage) are skipped
+// by the websocket without being buffered, and counted in skipped().
+//
+// The connection and subscriptions are set up in the constructor, so their
+// errors reach the caller. Later failures, and the server closing the
+// connection, end the thread; error() tells which, and the reader is woken
+// either way. As with IngestThread, the thread owns the handler until stop().
+//
+// With FeedConfig::busyPoll the idle path is a single recv() that finds
+// nothing; stop() and pings are checked without system calls.
+template <typename Handler, typename Transport = net::TcpTransport>
+class FeedThread : public TopPublisher<Handler> {
+ public:
+  FeedThread(Handler& handler, Transport transport, const std::string& host,
+             const std::string& path,
+             const std::vector<std::string>& subscriptions,
+             const size_t maxMarkets, const FeedConfig& config)
+      : TopPublisher<Handler>(handler, maxMarkets),
+        config_(checked(config)),
+        ws_(std::move(transport), host, path, Handler::kMaxMessage),
+        stopFd_(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+    if (stopFd_ < 0) {
+      throw std::runtime_error(std::string("eventfd failed: ") +
+                               std::strerror(errno));
+    }
+    try {
+      if (config.busyPollUs > 0 &&
+          ::setsockopt(ws_.fd(), SOL_SOCKET, SO_BUSY_POLL, &config.busyPollUs,
+                       sizeof(config.busyPollUs)) != 0) {
+        throw std::runtime_error(std::string("SO_BUSY_POLL failed: ") +
+                                 std::strerror(errno));
+      }
+      for (const auto& s : subscriptions) {
+        ws_.send(s);
+      }
+    } catch (...) {
+      ::close(stopFd_);
+      throw;
+    }
+    isolated_ = config.cpu >= 0 && util::isIsolated(config.cpu);
+    handler.setEventSink(
+        [this](std::span<const Event> events) { this->publish(events); },
+        kMaxBatch);
+    thread_ = std::thread([this] { run(); });
+  }
+  FeedThread(const FeedThread&) = delete;
+  FeedThread& operator=(const FeedThread&) = delete;
+  ~FeedThread() {
+    stop();
+    ::close(stopFd_);
+  }
+
+  void stop() {
+    if (thread_.joinable()) {
+      stopping_.store(true, std::memory_order_relaxed);
+      const uint64_t one = 1;
+      [[maybe_unused]] auto r = ::write(stopFd_, &one, sizeof(one));
+      thread_.join();
+      this->handler_.clearEventSink();
+    }
+  }
+
+  bool running() const { return running_.load(std::memory_order_acquire); }
+  // Why the thread ended on its own, empty if it didn't.
+  std::string error() const {
+    std::lock_guard lock(errorMutex_);
+    return error_;
+  }
+  // Messages read, and those the handler applied: not duplicates dropped by
+  // arbitration, nor control messages (subscribed, pong).
+  size_t received() const { return received_.load(std::memory_order_relaxed); }
+  size_t applied() const { return applied_.load(std::memory_order_relaxed); }
+  // messages too long for the handler, not in received()
+  size_t skipped() const { return skipped_.load(std::memory_order_relaxed); }
+  const FeedConfig& config() const { return config_; }
+  FeedStats stats() const {
+    constexpr auto kRelaxed = std::memory_order_relaxed;
+    return {polls_.load(kRelaxed), emptyPolls_.load(kRelaxed),
+            busyNs_.load(kRelaxed) / 1e9, idleNs_.load(kRelaxed) / 1e9,
+            isolated_};
+  }
+
+ private:
+  static constexpr size_t kMaxBatch = 1 << 16;
+
+  // only written by the feed thread
+  template <typename T>
+  static void add(std::atomic<T>& counter, const T n) {
+    counter.store(counter.load(std::memory_order_relaxed) + n,
+                  std::memory_order_relaxed);
+  }
+
+  static const FeedConfig& checked(const FeedConfig& config) {
+    if (config.cpu >= 0) {
+      util::checkCpu(config.cpu);
+    }
+    return config;
+  }
+
+  void run() {
+    try {
+      // pinned before the first read, so no message is applied elsewhere
+      if (config_.cpu >= 0) {
+        util::pinThread(::pthread_self(), config_.cpu);
+      }
+      loop();
+    } catch (const std::exception& e) {
+      std::lock_guard lock(errorMutex_);
+      error_ = e.what();
+    }
+    running_.store(false, std::memory_order_release);
+    this->signal();
+  }
+
+  void loop() {
+    auto& handler = this->handler_;
+    const auto onMessage = [&](const std::string_view msg) {
+      received_.fetch_add(1, std::memory_order_relaxed);
+      if (handler.onPadded(msg)) {
+        applied_.fetch_add(1, std::memory_order_relaxed);
+      }
+    };
+    // one pass over the socket, true if anything arrived
+    bool open = true;
+    const auto read = [&] {
+      const auto before = ws_.bytes();
+      open = ws_.poll(onMessage);
+      const bool got = ws_.bytes() != before;
+      if (got) {
+        handler.getEventBatcher()->flush();
+        skipped_.store(ws_.skipped(), std::memory_order_relaxed);
+      }
+      add<uint64_t>(polls_, 1);
+      add<uint64_t>(emptyPolls_, !got);
+      return got;
+    };
+    // frames that came with the handshake response wait for no event
+    read();
+    if (open && config_.busyPoll) {
+      spin(read, open);
+    } else if (open) {
+      wait(read, open);
+    }
+    if (!open) {
+      throw std::runtime_error("connection closed by the server");
+    }
+    try {
+      ws_.close();
+    } catch (const std::exception&) {
+    }
+  }
+
+  template <typename Read>
+  void spin(const Read& read, const bool& open) {
+    auto last = SteadyClock::now();
+    auto nextPing = last + config_.pingInterval;
+    while (open && !stopping_.load(std::memory_order_relaxed)) {
+      const bool got = read();
+      const auto now = SteadyClock::now();
+      add<int64_t>(got ? busyNs_ : idleNs_, (now - last).count());
+      last = now;
+      if (config_.pingInterval.count() > 0 && now >= nextPing) {
+        ws_.send(R"({"op": "ping"})");
+        nextPing += config_.pingInterval;
+      }
+    }
+  }
+
+  template <typename Read>
+  void wait(const Read& read, const bool& open) {
+    const int ep = ::epoll_create1(EPOLL_CLOEXEC);
+    if (ep < 0) {
+      throw std::runtime_error(std::string("epoll_create1 failed: ") +
+                               std::strerror(errno));
+    }
+    struct Closer {
+      int fd;
+      ~Closer() { ::close(fd); }
+    } closer{ep};
+    for (const int fd : {ws_.fd(), stopFd_}) {
+      epoll_event ev{};
+      ev.events = EPOLLIN;
+      ev.data.fd = fd;
+      if (::epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        throw std::runtime_error(std::string("epoll_ctl failed: ") +
+                                 std::strerror(errno));
+      }
+    }
+
+    const auto& pingInterval = config_.pingInterval;
+    auto nextPing = SteadyClock::now() + pingInterval;
+    epoll_event events[2];
+    for (;;) {
+      int timeout = -1;
+      auto start = SteadyClock::now();
+      if (pingInterval.count() > 0) {
+        timeout = int(std::max<int64_t>(
+            0, std::chrono::ceil<std::chrono::milliseconds>(nextPing - start)
+                   .count()));
+      }
+      const int n = ::epoll_wait(ep, events, 2, timeout);
+      if (n < 0 && errno != EINTR) {
+        throw std::runtime_error(std::string("epoll_wait failed: ") +
+                                 std::strerror(errno));
+      }
+      auto now = SteadyClock::now();
+      add<int64_t>(idleNs_, (now - start).count());
+      for (int i = 0; i < n; ++i) {
+        if (events[i].data.fd == stopFd_) {
+          return;
+        }
+        start = now;
+        read();
+        now = SteadyClock::now();
+        add<int64_t>(busyNs_, (now - start).count());
+        if (!open) {
+          return;
+        }
+      }
+      if (pingInterval.count() > 0 && now >= nextPing) {
+        ws_.send(R"({"op": "ping"})");
+        nextPing += pingInterval;
+      }
+    }
+  }
+
+  FeedConfig config_;  // checked before connecting
+  net::WebSocketClient<Transport> ws_;
+  int stopFd_;
+  bool isolated_{false};
+  std::atomic<bool> stopping_{false};
+  std::atomic<bool> running_{true};
+  std::atomic<size_t> received_{0};
+  std::atomic<size_t> applied_{0};
+  std::atomic<size_t> skipped_{0};
+  std::atomic<uint64_t> polls_{0};
+  std::atomic<uint64_t> emptyPolls_{0};
+  std::atomic<int64_t> busyNs_{0};
+  std::atomic<int64_t> idleNs_{0};
+  mutable std::mutex errorMutex_;
+  std::string error_;
+  std::thread thread_;
+};
+
+}  // namespace ngh::mkt
@@ -0,0 +1,299 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ngh/io/eventlog.h"
+#include "ngh/mkt/ftxhandler.h"
+#include "ngh/mkt/ftxstate.h"
+#include "simdjson.h"
+
+namespace ngh::mkt {
+
+// Converts raw FTX websocket messages into event records for an
+// io::EventLogWriter (or any sink with its intern() and write(), like
+// io::TickStoreWriter), with the same message coverage as FtxHandler. Every
+// record is stamped with the latest orderbook event time, the clock
+// FtxHandler runs on.
+template <typename Sink = io::EventLogWriter>
+class FtxEventLogConverter {
+ public:
+  explicit FtxEventLogConverter(Sink& out) : out_(out) {}
+
+  // `s` must be followed by SIMDJSON_PADDING readable bytes, see
+  // FtxHandler::onPadded().
+  bool onPadded(const std::string_view s) {
+    doc_ = parser_.iterate(s.data(), s.size(),
+                           s.size() + simdjson::SIMDJSON_PADDING);
+    std::string_view type = doc_["type"];
+    if (type == "update") {
+      std::string_view channel = doc_["channel"];
+      if (channel == "trades") {
+        const auto id = intern(doc_["market"]);
+        onTrade(id, doc_["data"]);
+      } else if (channel == "orderbook") {
+        onL2(doc_["market"], false);
+      } else if (channel == "fills") {
+        onFill(doc_["data"]);
+      } else if (channel == "orders") {
+        onOrder(doc_["data"]);
+      }
+      return true;
+    } else if (type == "partial") {  // must be orderbook
+      onL2(doc_["market"], true);
+      return true;
+    }
+    return false;
+  }
+
+ private:
+  uint32_t intern(const std::string_view name) {
+    const auto id = out_.intern(name);
+    if (id > std::numeric_limits<uint16_t>::max()) {
+      throw std::runtime_error("too many symbols for an event log");
+    }
+    return id;
+  }
+
+  void write(const uint8_t type, const uint32_t market, const Px px,
+             const Qty qty, const uint8_t flags = 0, const uint32_t sym = 0) {
+    out_.write({ns_, px, qty, market, type, flags, uint16_t(sym)});
+  }
+
+  void onL2(const std::string_view market, const bool partial) {
+    const auto id = intern(market);
+    auto data = doc_["data"].get_object();
+    ns_ = io::toNs(data["time"]);
+    write(io::EventRecord::kL2Begin, id, 0., 0.,
+          partial ? io::EventRecord::kPartial : 0);
+    for (auto upd : data["bids"].get_array()) {
+      auto it = upd.get_array().value().begin().value();
+      const Px px = *it;
+      const Qty qty = *(++it);
+      write(io::EventRecord::kLevel, id, px, qty);
+    }
+    for (auto upd : data["asks"].get_array()) {
+      auto it = upd.get_array().value().begin().value();
+      const Px px = *it;
+      const Qty qty = *(++it);
+      write(io::EventRecord::kLevel, id, px, qty, io::EventRecord::kSell);
+    }
+    write(io::EventRecord::kL2End, id, 0., 0.);
+  }
+
+  template <typename T>
+  void onTrade(const uint32_t id, T trades) {
+    for (auto trade : trades.get_array()) {
+      const Px px = trade["price"];
+      const Qty qty = Qty(trade["size"]) * (trade["side"] == "buy" ? 1 : -1);
+      write(io::EventRecord::kTrade, id, px, qty,
+            bool(trade["liquidation"]) ? io::EventRecord::kLiquidation : 0);
+    }
+  }
+
+  template <typename T>
+  void onFill(T fill) {
+    const auto sign = (fill["side"] == "buy") ? 1 : -1;
+    const auto qty = Qty(fill["size"]) * sign;
+    const Px px = fill["price"];
+    OID oid;
+    if (fill["orderId"].get(oid)) {
+      oid = 0;
+    }
+    const auto id = intern(fill["market"]);
+    const Qty fee = fill["fee"];
+    const auto ccy = intern(fill["feeCurrency"]);
+    write(io::EventRecord::kFill, id, px, qty, 0, ccy);
+    out_.write({oid, fee, 0., 0, io::EventRecord::kAux, 0, 0});
+  }
+
+  template <typename T>
+  void onOrder(T o) {
+    const auto id = intern(o["market"]);
+    const OID oid = o["id"];
+    const std::string_view status = o["status"];
+    if (status == "closed") {
+      // final sizes, NaN if the close didn't carry them
+      double filled = NAN, remaining = NAN;
+      if (o["filledSize"].get(filled)) {
+        filled = NAN;
+      }
+      if (o["remainingSize"].get(remaining)) {
+        remaining = NAN;
+      }
+      write(io::EventRecord::kOrder, id, 0., 0., io::EventRecord::kClosed);
+      out_.write({oid, filled, remaining, 0, io::EventRecord::kAux, 0, 0});
+      return;
+    }
+    const auto type = intern(o["type"]);
+    uint8_t flags = status == "new" ? io::EventRecord::kNew : 0;
+    if (o["side"] == "sell") {
+      flags |= io::EventRecord::kSell;
+    }
+    const Px price = o["price"];
+    const Qty size = o["size"];
+    const Qty filled = o["filledSize"];
+    const Qty remaining = o["remainingSize"];
+    flags |= bool(o["reduceOnly"]) ? io::EventRecord::kReduceOnly : 0;
+    flags |= bool(o["postOnly"]) ? io::EventRecord::kPostOnly : 0;
+    flags |= bool(o["ioc"]) ? io::EventRecord::kIoc : 0;
+    write(io::EventRecord::kOrder, id, price, size, flags, type);
+    out_.write({oid, filled, remaining, 0, io::EventRecord::kAux, 0, 0});
+  }
+
+  Sink& out_;
+  simdjson::ondemand::parser parser_;
+  simdjson::ondemand::document doc_;
+  int64_t ns_{0};
+};
+
+// Converts every line of `source` into `out`; returns the number of lines.
+// With a positive `checkpointInterval` (seconds of orderbook event time) the
+// lines are also applied to an FtxHandler whose state is embedded in the log
+// at every interval boundary, see seekEventLog().
+template <typename Source>
+size_t convertEventLog(Source& source, io::EventLogWriter& out,
+                       const double checkpointInterval = 0.) {
+  FtxEventLogConverter converter(out);
+  FtxHandler state;
+  std::string image;
+  double next = NAN;
+  size_t n = 0;
+  std::string_view line;
+  while (source.next(line)) {
+    converter.onPadded(line);
+    ++n;
+    if (checkpointInterval > 0.) {
+      state.onPadded(line);
+      if (state.lastTs >= next) {
+        image.clear();
+        saveState(state, image);
+        out.checkpoint(io::toNs(state.lastTs), image);
+      }
+      if ((std::isnan(next) && state.lastTs > 0.) || state.lastTs >= next) {
+        next = (std::floor(state.lastTs / checkpointInterval) + 1) *
+               checkpointInterval;
+      }
+    }
+  }
+  out.flush();
+  return n;
+}
+
+// Applies the records of `log` to `handler`, driving its books directly,
+// until the first one stamped past `until` (ns), which is left unread;
+// returns the number of records. Sampler and event sink behave as they do
+// for the json path.
+inline size_t replayEventLog(
+    io::EventLogReader& log, FtxHandler& handler,
+    const int64_t until = std::numeric_limits<int64_t>::max()) {
+  constexpr auto kNone = std::numeric_limits<MarketId>::max();
+  std::vector<MarketId> ids;  // by symbol id, markets only
+  const auto market = [&](const uint32_t sym) {
+    if (sym >= ids.size()) {
+      ids.resize(sym + 1, kNone);
+    }
+    if (ids[sym] == kNone) {
+      ids[sym] = handler.getMarketId(log.symbol(sym));
+    }
+    return ids[sym];
+  };
+  const auto aux = [&log] {
+    const auto* r = log.next();
+    if (!r || r->type != io::EventRecord::kAux) {
+      throw std::runtime_error("corrupt event log");
+    }
+    return r;
+  };
+
+  L2StateTracker* book = nullptr;
+  size_t n = 0;
+  for (const auto* r = log.next(); r; r = log.next(), ++n) {
+    if (r->ns > until) {
+      log.seek(log.tell() - 1);
+      break;
+    }
+    switch (r->type) {
+      case io::EventRecord::kL2Begin:
+        book = &handler.beginL2(market(r->market), io::fromNs(r->ns),
+                                r->flags & io::EventRecord::kPartial);
+        break;
+      case io::EventRecord::kLevel:
+        if (!book) {
+          throw std::runtime_error("corrupt event log");
+        }
+        book->applyLevel((r->flags & io::EventRecord::kSell) ? Side::kAsk
+                                                              : Side::kBid,
+                         r->px, r->qty);
+        break;
+      case io::EventRecord::kL2End:
+        handler.endL2(market(r->market));
+        book = nullptr;
+        break;
+      case io::EventRecord::kTrade:
+        handler.applyTrade(market(r->market), r->px, r->qty,
+                           r->flags & io::EventRecord::kLiquidation);
+        break;
+      case io::EventRecord::kFill: {
+        const auto* a = aux();
+        handler.applyFill(log.symbol(r->market), a->ns, r->px, r->qty, a->px,
+                          log.symbol(r->sym));
+        break;
+      }
+      case io::EventRecord::kOrder: {
+        const auto* a = aux();
+        Order order{};
+        order.id = a->ns;
+        if (r->flags & io::EventRecord::kClosed) {
+          order.status = "closed";
+          order.filledSize = a->px;
+          order.remainingSize = a->qty;
+        } else {
+          order.status = (r->flags & io::EventRecord::kNew) ? "new" : "open";
+          order.type = log.symbol(r->sym);
+          order.side = (r->flags & io::EventRecord::kSell) ? "sell" : "buy";
+          order.price = r->px;
+          order.size = r->qty;
+          order.filledSize = a->px;
+          order.remainingSize = a->qty;
+          order.reduceOnly = r->flags & io::EventRecord::kReduceOnly;
+          order.postOnly = r->flags & io::EventRecord::kPostOnly;
+          order.ioc = r->flags & io::EventRecord::kIoc;
+        }
+        handler.applyOrder(market(r->market), std::move(order));
+        break;
+      }
+      default:
+        throw std::runtime_error("corrupt event log");
+    }
+  }
+  return n;
+}
+
+// Rebuilds `handler` as of `ts` (seconds) from the latest checkpoint at or
+// before it, applying only the records after that; from the start of the
+// log when there is none. The log is left at the first record past `ts`.
+inline size_t seekEventLog(io::EventLogReader& log, FtxHandler& handler,
+                           const double ts) {
+  const auto until = io::toNs(ts);
+  const auto& checkpoints = log.checkpoints();
+  auto it = std::upper_bound(
+      checkpoints.begin(), checkpoints.end(), until,
+      [](const int64_t t, const io::EventLogCheckpoint& c) { return t < c.ns; });
+  if (it == checkpoints.begin()) {
+    handler.reset();
+    log.seek(0);
+  } else {
+    --it;
+    loadState(handler, log.image(*it));
+    log.seek(it->record);
+  }
+  return replayEventLog(log, handler, until);
+}
+
+}  // namespace ngh::mkt
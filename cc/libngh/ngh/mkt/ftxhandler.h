@@ -1,187 +1,405 @@
 #pragma once
 
+#include <deque>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <sstream>
 
-#include "date.h"
+#include "ngh/mkt/arbiter.h"
+#include "ngh/mkt/events.h"
+#include "ngh/mkt/feed.h"
+#include "ngh/mkt/ingest.h"
+#include "ngh/mkt/l2statetracker.h"
+#include "ngh/mkt/sampler.h"
 #include "ngh/types/types.h"
 #include "simdjson.h"
 
 namespace ngh::mkt {
-class L2StateTracker {
+class FtxHandler {
+  static constexpr auto BUFFER_SIZE = 64 * 1024;
+
  public:
-  template <typename T>
-  void onTrade(T trades) {
-    for (auto trade : trades.get_array()) {
-      lastTradePx = Px(trade["price"]);
-      lastTradeQty = Qty(trade["size"]) * (trade["side"] == "buy" ? 1 : -1);
-      lastTradeIsLiquidation = bool(trade["liquidation"]);
-      std::chrono::system_clock::time_point tp;
-      std::string_view ts = trade["time"];
-      std::istringstream ss{std::string(ts)};
-      ss >> date::parse("%FT%TZ", tp);
-      lastTradeTs =
-          std::chrono::duration<double>(tp.time_since_epoch()).count();
-      lastTradeTs = lastTs;
+  // longest message the parser takes, see onMessage()
+  static constexpr size_t kMaxMessage =
+      BUFFER_SIZE - simdjson::SIMDJSON_PADDING;
+
+  FtxHandler() { parser_.allocate(BUFFER_SIZE); }
+  FtxHandler(const FtxHandler&) = delete;
+  FtxHandler& operator=(const FtxHandler&) = delete;
+  ~FtxHandler() {
+    stopIngest();
+    stopFeed();
+  }
+  void reset() {
+    checkNotApplying();
+    stopIngest();
+    stopFeed();
+    balances.clear();
+    sampler_.reset();  // holds pointers into books_
+    if (events_) {
+      events_->flush();  // pending events refer to the old market ids
     }
+    books_.clear();
+    marketIds_.clear();
+    markets_.clear();
+    lastTs = 0.;
   }
 
-  template <typename T>
-  void onL2(T l2) {
-    lastTs = l2["time"];
-    for (auto upd : l2["bids"].get_array()) {
-      auto it = upd.get_array().value().begin().value();
-      const auto px = -double(*it);  // highest value up top
-      const Qty qty = *(++it);
-      if (qty == 0.) {
-        levels[0].erase(px);
-      } else {
-        levels[0][px] = qty;
-      }
+  // Market ids are dense and handed out in order of first appearance; they
+  // stay valid (as do references to their books) until reset().
+  MarketId getMarketId(const std::string_view s) {
+    auto it = marketIds_.find(s);
+    if (it == marketIds_.end()) {
+      it = marketIds_.emplace(s, MarketId(books_.size())).first;
+      books_.emplace_back();
+      markets_.emplace_back(s);
     }
+    return it->second;
+  }
+  const std::string& getMarket(const MarketId id) const { return markets_[id]; }
+  const std::vector<std::string>& getMarkets() const { return markets_; }
+  L2StateTracker& getBook(const std::string_view s) {
+    return books_[getMarketId(s)];
+  }
+  L2StateTracker& getBook(const MarketId id) { return books_[id]; }
+  const L2StateTracker& getBook(const MarketId id) const {
+    return books_[id];
+  }
 
-    for (auto upd : l2["asks"].get_array()) {
-      auto it = upd.get_array().value().begin().value();
-      Px px = *it;
-      Qty qty = *(++it);
-      if (qty == 0.) {
-        levels[1].erase(px);
-      } else {
-        levels[1][px] = qty;
-      }
+  size_t numOrders() const {
+    size_t n = 0;
+    for (const auto& book : books_) {
+      n += book.orders.size();
     }
-    // TODO(ANY): checksum?
+    return n;
+  }
+  // Writes the open orders of every market into `out` (numOrders() long);
+  // returns the number written.
+  size_t exportOrders(std::span<OrderRow> out) const {
+    size_t n = 0;
+    MarketId id = 0;
+    for (auto book = books_.begin(); book != books_.end(); ++book, ++id) {
+      n += book->exportOrders(id, out.subspan(n));
+    }
+    return n;
   }
 
-  template <typename T>
-  void onOrder(T o) {
-    OID oid = o["id"];
-    if (o["status"] == "closed") {
-      orders.erase(oid);
-    } else {
-      auto& order =
-          orders
-              .emplace(std::piecewise_construct, std::forward_as_tuple(oid),
-                       std::forward_as_tuple())
-              .first->second;
-      order.id = oid;
-      order.type = std::string_view(o["type"]);
-      order.side = std::string_view(o["side"]);
-      order.price = o["price"];
-      order.size = o["size"];
-      order.status = std::string_view(o["status"]);
-      order.filledSize = o["filledSize"];
-      order.remainingSize = o["remainingSize"];
-      order.reduceOnly = o["reduceOnly"];
-      order.postOnly = o["postOnly"];
-      order.ioc = o["ioc"];
-    }
-  }
-
-  PriceBook& getBids() { return levels[0]; }
-  PriceBook& getAsks() { return levels[1]; }
-
-  // public states
-  double lastTs{0.};
-  PriceBook levels[2];
+  // Writes the top of every book in MarketId order into `out`, in one pass
+  // over the trackers; returns the number written.
+  size_t getTops(std::span<TopOfBook> out) const {
+    const size_t n = std::min(out.size(), books_.size());
+    auto book = books_.begin();
+    for (MarketId id = 0; id < n; ++id, ++book) {
+      out[id] = book->getTop(id);
+    }
+    return n;
+  }
 
-  // trade
-  double lastTradeTs{0.};
-  Px lastTradePx{NAN};
-  Qty lastTradeQty{0.};
-  bool lastTradeIsLiquidation{false};
+  // Samples `markets` into `out` ([grid, market, depth, field]) while
+  // messages are applied, driven by orderbook event time.
+  BookSampler& attachSampler(const std::vector<std::string>& markets,
+                             const size_t depth, std::vector<double> grid,
+                             float* out) {
+    std::vector<const L2StateTracker*> books;
+    books.reserve(markets.size());
+    for (const auto& m : markets) {
+      books.push_back(&getBook(m));
+    }
+    sampler_ = std::make_unique<BookSampler>(std::move(books), depth,
+                                             std::move(grid), out);
+    return *sampler_;
+  }
+  void detachSampler() { sampler_.reset(); }
+  BookSampler* getSampler() { return sampler_.get(); }
 
-  // private states
-  OrderBook orders;
-};
+  // Batches book, trade, fill and order events into `sink`, see EventBatcher.
+  EventBatcher& setEventSink(EventBatcher::Sink sink, const size_t maxEvents) {
+    events_ = std::make_unique<EventBatcher>(std::move(sink), maxEvents);
+    return *events_;
+  }
+  void clearEventSink() { events_.reset(); }
+  EventBatcher* getEventBatcher() { return events_.get(); }
 
-class FtxHandler {
-  static constexpr auto BUFFER_SIZE = 64 * 1024;
+  // Hands message application to a background thread, see IngestThread;
+  // `capacity` is in bytes. A previous one is stopped first. Callers may
+  // keep the returned thread past stopIngest(), it is only stopped then.
+  //
+  // Only one thread may apply messages to a handler, so startIngest() and
+  // startFeed() refuse while the other one runs.
+  std::shared_ptr<IngestThread<FtxHandler>> startIngest(
+      const size_t capacity, const size_t maxMarkets) {
+    checkNotApplying();
+    if (feed_) {
+      throw std::runtime_error("a feed applies to this handler, stop it first");
+    }
+    stopIngest();
+    ingest_ = std::make_shared<IngestThread<FtxHandler>>(*this, capacity,
+                                                         maxMarkets);
+    return ingest_;
+  }
+  void stopIngest() {
+    if (ingest_) {
+      ingest_->stop();
+      ingest_.reset();
+    }
+  }
+  IngestThread<FtxHandler>* getIngest() { return ingest_.get(); }
 
- public:
-  FtxHandler() { parser_.allocate(BUFFER_SIZE); }
-  void reset() {
-    balances.clear();
-    books_.clear();
+  // Connects to a websocket feed (plain TCP) and applies it on a background
+  // thread, see FeedThread; like startIngest() otherwise.
+  std::shared_ptr<FeedThread<FtxHandler>> startFeed(
+      const std::string& host, const uint16_t port, const std::string& path,
+      const std::vector<std::string>& subscriptions, const size_t maxMarkets,
+      const FeedConfig& config) {
+    checkNotApplying();
+    if (ingest_) {
+      throw std::runtime_error(
+          "an ingest thread applies to this handler, stop it first");
+    }
+    if (config.cpu >= 0) {
+      util::checkCpu(config.cpu);  // before connecting
+    }
+    stopFeed();
+    feed_ = std::make_shared<FeedThread<FtxHandler>>(
+        *this, net::TcpTransport(host, port), host, path, subscriptions,
+        maxMarkets, config);
+    return feed_;
   }
-  L2StateTracker& getBook(const std::string_view s) {
-    return books_
-        .emplace(std::piecewise_construct, std::forward_as_tuple(s),
-                 std::forward_as_tuple())
-        .first->second;
+  void stopFeed() {
+    if (feed_) {
+      feed_->stop();
+      feed_.reset();
+    }
   }
+  FeedThread<FtxHandler>* getFeed() { return feed_.get(); }
 
-  bool onMessage(const std::string& s) {
-    strcpy(buffer_, s.c_str());
+  // Throws while a thread started above, or a call marked with Applying,
+  // applies messages to the handler. The threads don't check; callers that
+  // may share the handler with one (the Python bindings) do before anything
+  // else.
+  void checkIdle() const {
+    checkNotApplying();
+    if (ingest_) {
+      throw std::runtime_error(
+          "an ingest thread applies to this handler, stop it first");
+    }
+    if (feed_) {
+      throw std::runtime_error("a feed applies to this handler, stop it first");
+    }
+  }
+
+  // Drops repeated copies of messages from redundant connections before
+  // they are parsed, on every path into the handler, see FeedArbiter.
+  // Neither may be called while a thread applies messages (checkIdle());
+  // callers may keep the arbiter past disableArbitration().
+  std::shared_ptr<FeedArbiter> enableArbitration(const Duration window) {
+    checkIdle();
+    arbiter_ = std::make_shared<FeedArbiter>(window);
+    return arbiter_;
+  }
+  void disableArbitration() {
+    checkIdle();
+    arbiter_.reset();
+  }
+  FeedArbiter* getArbiter() { return arbiter_.get(); }
+
+  // Marks the handler busy for its lifetime, for a caller that applies
+  // messages without holding what its other users hold (the GIL, for the
+  // bindings); made and destroyed while holding it.
+  class Applying {
+   public:
+    explicit Applying(FtxHandler& handler) : handler_(handler) {
+      handler.checkIdle();
+      handler.applying_ = true;
+    }
+    Applying(const Applying&) = delete;
+    Applying& operator=(const Applying&) = delete;
+    ~Applying() { handler_.applying_ = false; }
+
+   private:
+    FtxHandler& handler_;
+  };
+
+  // False for unknown messages, messages too long to parse and arbitrated
+  // duplicates.
+  bool onMessage(const std::string_view s) {
+    if (!fits(s) || !arbitrate(s)) {
+      return false;
+    }
+    std::memcpy(buffer_, s.data(), s.size());
     doc_ = parser_.iterate(buffer_, s.size(), BUFFER_SIZE);
+    return dispatch();
+  }
+
+  // Parses `s` in place, without the copy; `s` must be followed by at least
+  // SIMDJSON_PADDING readable bytes (which line sources guarantee). Returns
+  // false like onMessage().
+  bool onPadded(const std::string_view s) {
+    if (!fits(s) || !arbitrate(s)) {
+      return false;
+    }
+    doc_ = parser_.iterate(s.data(), s.size(),
+                           s.size() + simdjson::SIMDJSON_PADDING);
+    return dispatch();
+  }
+
+  // Normalized event entry points, shared by the json path and binary event
+  // logs. An L2 update is beginL2(), applyLevel() on the book, then endL2();
+  // a partial replaces the book.
+  L2StateTracker& beginL2(const MarketId id, const double ts,
+                          const bool partial) {
+    if (sampler_) {
+      sampler_->advance(ts);
+    }
+    lastTs = ts;
+    auto& book = books_[id];
+    if (partial) {
+      book.levels[0].clear();
+      book.levels[1].clear();
+    }
+    book.lastTs = ts;
+    return book;
+  }
+  void endL2(const MarketId id) {
+    if (events_) {
+      events_->onBook(id, books_[id].lastTs);
+    }
+  }
+  void applyTrade(const MarketId id, const Px px, const Qty qty,
+                  const bool liquidation) {
+    auto& book = books_[id];
+    book.applyTrade(px, qty, liquidation);
+    if (events_) {
+      events_->onTrade(id, book.lastTradeTs, px, qty, liquidation);
+    }
+  }
+  void applyOrder(const MarketId id, Order order) {
+    if (events_) {
+      books_[id].applyOrder(std::move(order), [&](const Order& o) {
+        events_->onOrder(id, lastTs, o);
+      });
+    } else {
+      books_[id].applyOrder(std::move(order), [](const Order&) {});
+    }
+  }
+  // `qty` is signed; fees are charged in `feeCurrency`
+  void applyFill(const std::string_view market, const OID oid, const Px px,
+                 const Qty qty, const Qty fee,
+                 const std::string_view feeCurrency) {
+    const size_t offset = market.find('/');
+    const auto base =
+        (offset != std::string::npos) ? market.substr(0, offset) : market;
+    getBalance(base) += qty;
+    const auto paid = (offset != std::string::npos) ? market.substr(offset + 1)
+                                                    : std::string_view("USD");
+    getBalance(paid) -= qty * px;
+    getBalance(feeCurrency) -= fee;
+    if (events_) {
+      events_->onFill(getMarketId(market), lastTs, oid, px, qty);
+    }
+  }
+  Qty& getBalance(const std::string_view ccy) {
+    auto it = balances.find(ccy);
+    if (it == balances.end()) {
+      it = balances.emplace(ccy, 0.).first;
+    }
+    return it->second;
+  }
+
+  // latest orderbook event time across all markets
+  double lastTs{0.};
+  Balances balances;
+
+ private:
+  void checkNotApplying() const {
+    if (applying_) {
+      throw std::runtime_error(
+          "another call applies messages to this handler, wait for it");
+    }
+  }
+
+  // The parser's capacity (and the copy buffer) bound messages on both paths.
+  static bool fits(const std::string_view s) {
+    return s.size() <= kMaxMessage;
+  }
+  // False for a copy already seen, when arbitration is on.
+  bool arbitrate(const std::string_view s) {
+    return !arbiter_ || arbiter_->accept(s);
+  }
+
+  bool dispatch() {
     std::string_view type = doc_["type"];
     if (type == "update") {
       std::string_view channel = doc_["channel"];
       if (channel == "trades") {
-        std::string_view market = doc_["market"];
-        getBook(market).onTrade(doc_["data"]);
+        const auto id = getMarketId(doc_["market"]);
+        auto& book = books_[id];
+        if (events_) {
+          book.onTrade(doc_["data"], [&] {
+            events_->onTrade(id, book.lastTradeTs, book.lastTradePx,
+                             book.lastTradeQty, book.lastTradeIsLiquidation);
+          });
+        } else {
+          book.onTrade(doc_["data"]);
+        }
       } else if (channel == "orderbook") {
-        std::string_view market = doc_["market"];
-        auto& book = getBook(market);
-        book.onL2(doc_["data"]);
+        onL2(doc_["market"], false);
       } else if (channel == "fills") {
         onFill(doc_["data"]);
       } else if (channel == "orders") {
-        getBook(doc_["data"]["market"]).onOrder(doc_["data"]);
+        const auto id = getMarketId(doc_["data"]["market"]);
+        if (events_) {
+          books_[id].onOrder(doc_["data"], [&](const Order& o) {
+            events_->onOrder(id, lastTs, o);
+          });
+        } else {
+          books_[id].onOrder(doc_["data"]);
+        }
       }
       return true;
     } else if (type == "partial") {  // must be orderbook
-      std::string_view market = doc_["market"];
-      auto& book =
-          books_
-              .emplace(std::piecewise_construct, std::forward_as_tuple(market),
-                       std::forward_as_tuple())
-              .first->second;
-      book.onL2(doc_["data"]);
+      onL2(doc_["market"], true);
       return true;
     }
     return false;
   }
-  Balances balances;
 
- private:
   template <typename T>
   void onFill(T fill) {
     const auto sign = (fill["side"] == "buy") ? 1 : -1;
     const auto qty = Qty(fill["size"]) * sign;
-    const std::string mkt{std::string_view(fill["market"])};
-    size_t offset = mkt.find('/');
-    const auto base =
-        (offset != std::string::npos) ? mkt.substr(0, offset) : mkt;
-    balances
-        .emplace(std::piecewise_construct, std::forward_as_tuple(base),
-                 std::forward_as_tuple(0.))
-        .first->second += qty;
-
-    const auto paid =
-        (offset != std::string::npos) ? mkt.substr(offset) : "USD";
-    const auto ntl = qty * double(fill["price"]);
-    balances
-        .emplace(std::piecewise_construct, std::forward_as_tuple(paid),
-                 std::forward_as_tuple(0.))
-        .first->second -= ntl;
-
-    balances
-        .emplace(std::piecewise_construct,
-                 std::forward_as_tuple(std::string_view(fill["feeCurrency"])),
-                 std::forward_as_tuple(0.))
-        .first->second -= double(fill["fee"]);
+    const Px px = fill["price"];
+    OID oid;
+    if (fill["orderId"].get(oid)) {
+      oid = 0;
+    }
+    applyFill(fill["market"], oid, px, qty, fill["fee"], fill["feeCurrency"]);
     // fill["time"];
     // fill["type"];
     // fill["tradeId"];
   }
 
+  void onL2(const std::string_view market, const bool partial) {
+    const auto id = getMarketId(market);
+    auto data = doc_["data"].get_object();
+    beginL2(id, data["time"], partial).onL2(data);
+    endL2(id);
+  }
+
   simdjson::ondemand::parser parser_{BUFFER_SIZE};
   simdjson::ondemand::document doc_;
   char buffer_[BUFFER_SIZE];
 
-  std::map<std::string, L2StateTracker> books_;
+  std::deque<L2StateTracker> books_;  // indexed by MarketId
+  std::map<std::string, MarketId, std::less<>> marketIds_;
+  std::vector<std::string> markets_;
+  std::unique_ptr<BookSampler> sampler_;
+  std::unique_ptr<EventBatcher> events_;
+  std::shared_ptr<FeedArbiter> arbiter_;
+  std::shared_ptr<IngestThread<FtxHandler>> ingest_;
+  std::shared_ptr<FeedThread<FtxHandler>> feed_;
+  bool applying_{false};  // see Applying
 };
 
 }  // namespace ngh::mkt
\ No newline at end of file
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "ngh/mkt/ftxhandler.h"
+
+namespace ngh::mkt {
+
+// Compact binary image of an FtxHandler: books, orders, balances and last
+// trade state. Levels are written as flat (px, qty) arrays in book order so
+// loading is a hinted append per level. Native endianness, meant for
+// pickling and checkpoints between processes on the same kind of host.
+namespace state {
+
+constexpr uint32_t kMagic = 0x5348474e;  // "NGHS"
+constexpr uint32_t kVersion = 1;
+
+struct Header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t numMarkets;
+  uint32_t numBalances;
+  double lastTs;
+};
+
+struct BookHeader {
+  double lastTs;
+  double lastTradeTs;
+  Px lastTradePx;
+  Qty lastTradeQty;
+  uint32_t numBids;
+  uint32_t numAsks;
+  uint32_t numOrders;
+  uint8_t lastTradeIsLiquidation;
+  uint8_t pad[3];  // value initialized so images are deterministic
+};
+
+struct Level {
+  Px px;
+  Qty qty;
+};
+
+struct OrderRecord {
+  OID id;
+  Px price;
+  Qty size;
+  Qty filledSize;
+  Qty remainingSize;
+  uint8_t reduceOnly;
+  uint8_t postOnly;
+  uint8_t ioc;
+  uint8_t pad[5];
+};
+
+class Writer {
+ public:
+  explicit Writer(std::string& out) : out_(out) {}
+  template <typename T>
+  void put(const T& v) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    out_.append(reinterpret_cast<const char*>(&v), sizeof(T));
+  }
+  void putStr(const std::string_view s) {
+    put(uint32_t(s.size()));
+    out_.append(s);
+  }
+
+ private:
+  std::string& out_;
+};
+
+class Reader {
+ public:
+  explicit Reader(std::string_view in,
+                  const char* what = "truncated FtxHandler state")
+      : in_(in), what_(what) {}
+  template <typename T>
+  T get() {
+    static_assert(std::is_trivially_copyable_v<T>);
+    T v;
+    std::memcpy(&v, take(sizeof(T)), sizeof(T));
+    return v;
+  }
+  std::string_view str() {
+    const auto n = get<uint32_t>();
+    return {take(n), n};
+  }
+
+ private:
+  const char* take(const size_t n) {
+    if (n > in_.size()) {
+      throw std::runtime_error(what_);
+    }
+    const char* p = in_.data();
+    in_.remove_prefix(n);
+    return p;
+  }
+  std::string_view in_;
+  const char* what_;
+};
+
+inline void putLevels(Writer& w, const PriceBook& levels) {
+  for (const auto& [px, qty] : levels) {
+    w.put(Level{px, qty});
+  }
+}
+
+inline void getLevels(Reader& r, PriceBook& levels, const uint32_t n) {
+  for (uint32_t i = 0; i < n; ++i) {
+    const auto l = r.get<Level>();
+    levels.emplace_hint(levels.end(), l.px, l.qty);
+  }
+}
+
+}  // namespace state
+
+// Appends the state of `h` to `out`.
+inline void saveState(const FtxHandler& h, std::string& out) {
+  const auto& markets = h.getMarkets();
+  size_t size = sizeof(state::Header);
+  for (MarketId id = 0; id < markets.size(); ++id) {
+    const auto& book = h.getBook(id);
+    size += sizeof(uint32_t) + markets[id].size() + sizeof(state::BookHeader) +
+            (book.levels[0].size() + book.levels[1].size()) *
+                sizeof(state::Level) +
+            book.orders.size() * (sizeof(state::OrderRecord) + 32);
+  }
+  out.reserve(out.size() + size + h.balances.size() * 16);
+
+  state::Writer w(out);
+  w.put(state::Header{state::kMagic, state::kVersion, uint32_t(markets.size()),
+                      uint32_t(h.balances.size()), h.lastTs});
+  for (MarketId id = 0; id < markets.size(); ++id) {
+    const auto& book = h.getBook(id);
+    w.putStr(markets[id]);
+    w.put(state::BookHeader{
+        book.lastTs, book.lastTradeTs, book.lastTradePx, book.lastTradeQty,
+        uint32_t(book.levels[0].size()), uint32_t(book.levels[1].size()),
+        uint32_t(book.orders.size()), book.lastTradeIsLiquidation});
+    state::putLevels(w, book.levels[0]);
+    state::putLevels(w, book.levels[1]);
+    for (const auto& [oid, o] : book.orders) {
+      w.put(state::OrderRecord{o.id, o.price, o.size, o.filledSize,
+                               o.remainingSize, o.reduceOnly, o.postOnly,
+                               o.ioc});
+      w.putStr(o.type);
+      w.putStr(o.side);
+      w.putStr(o.status);
+    }
+  }
+  for (const auto& [ccy, qty] : h.balances) {
+    w.putStr(ccy);
+    w.put(qty);
+  }
+}
+
+inline std::string saveState(const FtxHandler& h) {
+  std::string out;
+  saveState(h, out);
+  return out;
+}
+
+// Replaces the state of `h` with a saveState() image. Market ids are
+// restored in their original order.
+inline void loadState(FtxHandler& h, const std::string_view in) {
+  state::Reader r(in);
+  const auto header = r.get<state::Header>();
+  if (header.magic != state::kMagic || header.version != state::kVersion) {
+    throw std::runtime_error("not an FtxHandler state image");
+  }
+  h.reset();
+  h.lastTs = header.lastTs;
+  for (uint32_t i = 0; i < header.numMarkets; ++i) {
+    auto& book = h.getBook(r.str());
+    const auto bh = r.get<state::BookHeader>();
+    book.lastTs = bh.lastTs;
+    book.lastTradeTs = bh.lastTradeTs;
+    book.lastTradePx = bh.lastTradePx;
+    book.lastTradeQty = bh.lastTradeQty;
+    book.lastTradeIsLiquidation = bh.lastTradeIsLiquidation;
+    state::getLevels(r, book.levels[0], bh.numBids);
+    state::getLevels(r, book.levels[1], bh.numAsks);
+    for (uint32_t j = 0; j < bh.numOrders; ++j) {
+      const auto rec = r.get<state::OrderRecord>();
+      auto& o = book.orders.emplace_hint(book.orders.end(), rec.id, Order{})
+                    ->second;
+      o.id = rec.id;
+      o.price = rec.price;
+      o.size = rec.size;
+      o.filledSize = rec.filledSize;
+      o.remainingSize = rec.remainingSize;
+      o.reduceOnly = rec.reduceOnly;
+      o.postOnly = rec.postOnly;
+      o.ioc = rec.ioc;
+      o.type = r.str();
+      o.side = r.str();
+      o.status = r.str();
+    }
+  }
+  for (uint32_t i = 0; i < header.numBalances; ++i) {
+    const auto ccy = r.str();
+    h.balances.emplace_hint(h.balances.end(), ccy, r.get<Qty>());
+  }
+}
+
+}  // namespace ngh::mkt
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <functional>
+#include <limits>
+#include <queue>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "ngh/io/eventlog.h"
+#include "ngh/io/tickstore.h"
+#include "ngh/mkt/ftxeventlog.h"
+#include "ngh/mkt/ftxhandler.h"
+#include "ngh/mkt/l2statetracker.h"
+
+namespace ngh::mkt {
+
+// Converts the orderbook updates and trades of every line of `source` into
+// `out`, which still needs a close(); returns the number of lines.
+template <typename Source>
+size_t convertTickStore(Source& source, io::TickStoreWriter& out) {
+  FtxEventLogConverter converter(out);
+  size_t n = 0;
+  std::string_view line;
+  while (source.next(line)) {
+    converter.onPadded(line);
+    ++n;
+  }
+  return n;
+}
+
+// Applies one block straight to the book of its market; returns the number
+// of events.
+inline size_t decodeTickBlock(const io::TickStoreReader& store,
+                              const io::TickBlock& block,
+                              L2StateTracker& book) {
+  io::TickBlockCursor cursor(store.block(block));
+  const auto level = [&book](const Side side, const Px px, const Qty qty) {
+    book.applyLevel(side, px, qty);
+  };
+  const auto trade = [&book](const Px px, const Qty qty, const bool liq) {
+    book.applyTrade(px, qty, liq);
+  };
+  size_t n = 0;
+  for (; !cursor.done(); ++n) {
+    if (!cursor.isTrade()) {
+      if (cursor.isPartial()) {
+        book.levels[0].clear();
+        book.levels[1].clear();
+      }
+      book.lastTs = io::fromNs(cursor.ns());
+    }
+    cursor.pop(level, trade);
+  }
+  return n;
+}
+
+// Replays a whole store into `handler`, merging the blocks of each hour by
+// event time (ties go to the block listed first), so samplers and event sinks
+// see one timeline as they do for the json path. Returns the number of
+// events.
+inline size_t replayTickStore(const io::TickStoreReader& store,
+                              FtxHandler& handler) {
+  constexpr auto kNone = std::numeric_limits<MarketId>::max();
+  std::vector<MarketId> ids(store.numSymbols(), kNone);
+  const auto& blocks = store.blocks();
+  std::vector<io::TickBlockCursor> cursors;
+  std::vector<MarketId> markets;  // of the cursors
+  using Entry = std::pair<int64_t, size_t>;  // (ns, cursor)
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<>> heap;
+
+  size_t n = 0;
+  for (size_t first = 0; first < blocks.size();) {
+    size_t last = first;
+    cursors.clear();
+    markets.clear();
+    for (; last < blocks.size() && blocks[last].hour == blocks[first].hour;
+         ++last) {
+      auto& id = ids[blocks[last].market];
+      if (id == kNone) {
+        id = handler.getMarketId(store.symbol(blocks[last].market));
+      }
+      cursors.emplace_back(store.block(blocks[last]));
+      markets.push_back(id);
+      if (!cursors.back().done()) {
+        heap.emplace(cursors.back().ns(), cursors.size() - 1);
+      }
+    }
+    first = last;
+
+    while (!heap.empty()) {
+      const auto i = heap.top().second;
+      heap.pop();
+      auto& cursor = cursors[i];
+      const auto id = markets[i];
+      if (cursor.isTrade()) {
+        cursor.pop([](Side, Px, Qty) {},
+                   [&](const Px px, const Qty qty, const bool liq) {
+                     handler.applyTrade(id, px, qty, liq);
+                   });
+      } else {
+        auto& book = handler.beginL2(id, io::fromNs(cursor.ns()),
+                                     cursor.isPartial());
+        cursor.pop(
+            [&book](const Side side, const Px px, const Qty qty) {
+              book.applyLevel(side, px, qty);
+            },
+            [](Px, Qty, bool) {});
+        handler.endL2(id);
+      }
+      ++n;
+      if (!cursor.done()) {
+        heap.emplace(cursor.ns(), i);
+      }
+    }
+  }
+  return n;
+}
+
+}  // namespace ngh::mkt
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "ngh/mkt/events.h"
+#include "ngh/mkt/l2statetracker.h"
+#include "ngh/util/spsc.h"
+#include "simdjson.h"
+
+namespace ngh::mkt {
+
+// Lock-free publication of handler results to a reader on another thread:
+// the top of book of each changed market goes into a seqlock slot, and an
+// eventfd (for asyncio's add_reader) is signalled once per batch until the
+// reader ack()s. Neither side ever waits on the other. publish() is meant to
+// be the handler's event sink, called by the thread that owns the handler;
+// a handler that already has a sink is rejected rather than have it dropped.
+template <typename Handler>
+class TopPublisher {
+ public:
+  TopPublisher(Handler& handler, const size_t maxMarkets)
+      : handler_(handler),
+        slots_(std::make_unique<Slot[]>(maxMarkets)),
+        names_(std::make_unique<std::string[]>(maxMarkets)),
+        maxMarkets_(maxMarkets),
+        fd_(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+    if (fd_ < 0) {
+      throw std::runtime_error(std::string("eventfd failed: ") +
+                               std::strerror(errno));
+    }
+    if (handler.getEventBatcher()) {
+      ::close(fd_);
+      throw std::invalid_argument(
+          "the handler already has an event sink, clear it first");
+    }
+  }
+  TopPublisher(const TopPublisher&) = delete;
+  TopPublisher& operator=(const TopPublisher&) = delete;
+  ~TopPublisher() { ::close(fd_); }
+
+  // Reader side. Clears the pending signal; read state after calling.
+  int fd() const { return fd_; }
+  void ack() {
+    signalled_.store(false, std::memory_order_seq_cst);
+    uint64_t n;
+    [[maybe_unused]] auto r = ::read(fd_, &n, sizeof(n));
+  }
+
+  // Consistent copy of the last published top of `market`; false if the
+  // market has not been seen yet.
+  bool getTop(const MarketId market, TopOfBook& out) const {
+    if (market >= numMarkets()) {
+      return false;
+    }
+    const auto& slot = slots_[market];
+    while (true) {
+      const auto seq = slot.seq.load(std::memory_order_acquire);
+      if (seq & 1) {
+        continue;
+      }
+      std::memcpy(&out, &slot.top, sizeof(out));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.seq.load(std::memory_order_relaxed) == seq) {
+        return true;
+      }
+    }
+  }
+  // published markets, indexed by MarketId
+  size_t numMarkets() const {
+    return numMarkets_.load(std::memory_order_acquire);
+  }
+  const std::string& getMarket(const MarketId market) const {
+    return names_[market];
+  }
+
+ protected:
+  void publish(std::span<const Event> events) {
+    bool changed = false;
+    for (const auto& e : events) {
+      if (e.type != uint8_t(EventType::kBook) &&
+          e.type != uint8_t(EventType::kTrade)) {
+        continue;
+      }
+      if (e.market >= maxMarkets_) {
+        continue;
+      }
+      publishNames(e.market);
+      auto& slot = slots_[e.market];
+      const auto seq = slot.seq.load(std::memory_order_relaxed);
+      slot.seq.store(seq + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      slot.top = handler_.getBook(e.market).getTop(e.market);
+      slot.seq.store(seq + 2, std::memory_order_release);
+      changed = true;
+    }
+    if (changed) {
+      signal();
+    }
+  }
+
+  // Wakes the reader unless it has not acked the last wake up yet.
+  void signal() {
+    if (!signalled_.exchange(true, std::memory_order_seq_cst)) {
+      const uint64_t one = 1;
+      [[maybe_unused]] auto r = ::write(fd_, &one, sizeof(one));
+    }
+  }
+
+  Handler& handler_;
+
+ private:
+  struct alignas(util::kCacheLine) Slot {
+    std::atomic<uint64_t> seq{0};
+    TopOfBook top{0, NAN, 0., NAN, 0., NAN};
+  };
+
+  // names are written once, before their id becomes visible
+  void publishNames(const MarketId market) {
+    auto n = numMarkets_.load(std::memory_order_relaxed);
+    if (market < n) {
+      return;
+    }
+    for (; n <= market; ++n) {
+      names_[n] = handler_.getMarket(n);
+    }
+    numMarkets_.store(n, std::memory_order_release);
+  }
+
+  std::unique_ptr<Slot[]> slots_;
+  std::unique_ptr<std::string[]> names_;
+  size_t maxMarkets_;
+  int fd_;
+  std::atomic<bool> signalled_{false};
+  std::atomic<size_t> numMarkets_{0};
+};
+
+// Background thread applying raw messages to a handler. Messages are copied
+// into a lock-free byte ring of `capacity` bytes, parsed straight from it in
+// batches, and results are published through a TopPublisher.
+//
+// The thread owns the handler while running, including its event sink; the
+// handler may only be read directly after stop(). A message the handler
+// throws on ends the thread; error() tells why, and the reader is woken.
+template <typename Handler>
+class IngestThread : public TopPublisher<Handler> {
+ public:
+  IngestThread(Handler& handler, const size_t capacity, const size_t maxMarkets)
+      : TopPublisher<Handler>(handler, maxMarkets),
+        ring_(capacity, simdjson::SIMDJSON_PADDING) {
+    // flushed by run() after every drained batch
+    handler.setEventSink(
+        [this](std::span<const Event> events) { this->publish(events); },
+        kMaxBatch);
+    thread_ = std::thread([this] { run(); });
+  }
+  IngestThread(const IngestThread&) = delete;
+  IngestThread& operator=(const IngestThread&) = delete;
+  ~IngestThread() { stop(); }
+
+  void stop() {
+    stopping_.store(true, std::memory_order_relaxed);
+    if (thread_.joinable()) {
+      thread_.join();
+      this->handler_.clearEventSink();
+    }
+  }
+
+  // producer side, false (and counted) when the ring is full
+  bool push(const std::string_view msg) { return ring_.push(msg); }
+
+  bool running() const { return running_.load(std::memory_order_acquire); }
+  // Why the thread ended on its own, empty if it didn't.
+  std::string error() const {
+    std::lock_guard lock(errorMutex_);
+    return error_;
+  }
+  size_t applied() const { return applied_.load(std::memory_order_relaxed); }
+  size_t dropped() const { return ring_.stats().rejected; }
+  util::SpscRingStats stats() const { return ring_.stats(); }
+
+ private:
+  static constexpr size_t kMaxBatch = 1 << 16;
+  static constexpr int kSpinsBeforeSleep = 1024;
+  static constexpr auto kIdleSleep = std::chrono::microseconds(20);
+
+  void run() {
+    try {
+      loop();
+    } catch (const std::exception& e) {
+      std::lock_guard lock(errorMutex_);
+      error_ = e.what();
+    }
+    running_.store(false, std::memory_order_release);
+    this->signal();
+  }
+
+  void loop() {
+    auto& handler = this->handler_;
+    const auto apply = [&handler](const std::string_view msg) {
+      handler.onPadded(msg);
+    };
+    int idle = 0;
+    while (!stopping_.load(std::memory_order_relaxed)) {
+      const auto n = ring_.drain(apply, kMaxBatch);
+      if (n) {
+        idle = 0;
+        applied_.fetch_add(n, std::memory_order_relaxed);
+        handler.getEventBatcher()->flush();
+      } else if (++idle > kSpinsBeforeSleep) {
+        std::this_thread::sleep_for(kIdleSleep);
+      }
+    }
+  }
+
+  util::SpscByteRing ring_;
+  std::atomic<bool> stopping_{false};
+  std::atomic<bool> running_{true};
+  std::atomic<size_t> applied_{0};
+  mutable std::mutex errorMutex_;
+  std::string error_;
+  std::thread thread_;
+};
+
+}  // namespace ngh::mkt
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <cmath>
+#include <span>
+
+#include "ngh/types/types.h"
+
+namespace ngh::mkt {
+
+struct TopOfBook {
+  MarketId market;
+  Px bidPx;
+  Qty bidSz;
+  Px askPx;
+  Qty askSz;
+  double lastTs;
+};
+
+class L2StateTracker {
+ public:
+  // `f()` is called after each trade is applied
+  template <typename T, typename F>
+  void onTrade(T trades, F&& f) {
+    for (auto trade : trades.get_array()) {
+      const Px px = trade["price"];
+      const Qty qty = Qty(trade["size"]) * (trade["side"] == "buy" ? 1 : -1);
+      applyTrade(px, qty, bool(trade["liquidation"]));
+      f();
+    }
+  }
+  template <typename T>
+  void onTrade(T trades) {
+    onTrade(trades, [] {});
+  }
+
+  template <typename T>
+  void onL2(T l2) {
+    lastTs = l2["time"];
+    for (auto upd : l2["bids"].get_array()) {
+      auto it = upd.get_array().value().begin().value();
+      const Px px = *it;
+      const Qty qty = *(++it);
+      applyLevel(Side::kBid, px, qty);
+    }
+
+    for (auto upd : l2["asks"].get_array()) {
+      auto it = upd.get_array().value().begin().value();
+      const Px px = *it;
+      const Qty qty = *(++it);
+      applyLevel(Side::kAsk, px, qty);
+    }
+    // TODO(ANY): checksum?
+  }
+
+  // Normalized updates, shared by the json handlers and binary event logs.
+  void applyLevel(const Side side, const Px px, const Qty qty) {
+    auto& book = levels[IsBid(side) ? 0 : 1];
+    const Px key = IsBid(side) ? -px : px;  // highest value up top
+    if (qty == 0.) {
+      book.erase(key);
+    } else {
+      book[key] = qty;
+    }
+  }
+  void applyTrade(const Px px, const Qty qty, const bool liquidation) {
+    lastTradePx = px;
+    lastTradeQty = qty;
+    lastTradeIsLiquidation = liquidation;
+    lastTradeTs = lastTs;
+  }
+  template <typename F>
+  void applyOrder(Order order, F&& f) {
+    if (order.status == "closed") {
+      auto it = orders.find(order.id);
+      if (it != orders.end()) {
+        // the final fill comes with the close, NaN where it didn't
+        auto& last = it->second;
+        last.status = "closed";
+        if (!std::isnan(order.filledSize)) {
+          last.filledSize = order.filledSize;
+        }
+        if (!std::isnan(order.remainingSize)) {
+          last.remainingSize = order.remainingSize;
+        }
+        f(last);
+        orders.erase(it);
+      }
+    } else {
+      auto& o = orders[order.id];
+      o = std::move(order);
+      f(o);
+    }
+  }
+
+  // `f(order)` is called with the updated order; closed orders are reported
+  // with their last known state, sizes from the close, before being dropped
+  template <typename T, typename F>
+  void onOrder(T o, F&& f) {
+    Order order{};
+    order.id = o["id"];
+    order.status = std::string_view(o["status"]);
+    if (order.status != "closed") {
+      order.type = std::string_view(o["type"]);
+      order.side = std::string_view(o["side"]);
+      order.price = o["price"];
+      order.size = o["size"];
+      order.filledSize = o["filledSize"];
+      order.remainingSize = o["remainingSize"];
+      order.reduceOnly = o["reduceOnly"];
+      order.postOnly = o["postOnly"];
+      order.ioc = o["ioc"];
+    } else {
+      order.filledSize = NAN;
+      order.remainingSize = NAN;
+      double v;
+      if (!o["filledSize"].get(v)) {
+        order.filledSize = v;
+      }
+      if (!o["remainingSize"].get(v)) {
+        order.remainingSize = v;
+      }
+    }
+    applyOrder(std::move(order), f);
+  }
+  template <typename T>
+  void onOrder(T o) {
+    onOrder(o, [](const Order&) {});
+  }
+
+  PriceBook& getBids() { return levels[0]; }
+  PriceBook& getAsks() { return levels[1]; }
+
+  // Writes open orders into `out`; returns the number written.
+  size_t exportOrders(const MarketId market, std::span<OrderRow> out) const {
+    size_t n = 0;
+    for (auto it = orders.begin(); it != orders.end() && n < out.size();
+         ++it) {
+      out[n++] = toRow(it->second, market);
+    }
+    return n;
+  }
+
+  // NaN price and zero size for an empty side
+  TopOfBook getTop(const MarketId market) const {
+    TopOfBook top{market, NAN, 0., NAN, 0., lastTs};
+    if (!levels[0].empty()) {
+      top.bidPx = -levels[0].begin()->first;
+      top.bidSz = levels[0].begin()->second;
+    }
+    if (!levels[1].empty()) {
+      top.askPx = levels[1].begin()->first;
+      top.askSz = levels[1].begin()->second;
+    }
+    return top;
+  }
+
+  // public states
+  double lastTs{0.};
+  PriceBook levels[2];
+
+  // trade
+  double lastTradeTs{0.};
+  Px lastTradePx{NAN};
+  Qty lastTradeQty{0.};
+  bool lastTradeIsLiquidation{false};
+
+  // private states
+  OrderBook orders;
+};
+
+}  // namespace ngh::mkt
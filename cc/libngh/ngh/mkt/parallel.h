@@ -0,0 +1,179 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "ngh/io/mmapreader.h"
+#include "ngh/io/scan.h"
+#include "ngh/mkt/ftxhandler.h"
+#include "ngh/mkt/sampler.h"
+#include "ngh/util/spsc.h"
+
+namespace ngh::mkt {
+
+// Replays one uncompressed capture with its markets split across `threads`
+// workers (all cores when 0), since books of different markets are
+// independent. The calling thread pre-scans each line for its "market" only
+// and routes it, as a view into the mapping, to the queue of the worker that
+// owns the market; markets are dealt out round robin on first sight,
+// `markets` first. Every worker applies its lines in capture order to its
+// own FtxHandler, so each market sees exactly the sequence a serial replay
+// would. Lines without a market are skipped.
+//
+// `markets` are sampled on `grid` into `out` ([grid, market, level, field],
+// as BookSampler). If `merged` is given it receives the end state: every
+// book (ids in order of first appearance), summed balances and the latest
+// event time. Returns the number of lines routed.
+inline size_t replayByMarket(const std::string& path,
+                             const std::vector<std::string>& markets,
+                             const size_t depth, const std::vector<double>& grid,
+                             float* out, size_t threads,
+                             FtxHandler* merged = nullptr,
+                             const size_t queueCapacity = 1 << 16) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  io::MmapLineReader reader(path);  // outlives the workers' line views
+  struct Worker {
+    explicit Worker(const size_t capacity) : queue(capacity) {}
+    util::SpscQueue<std::string_view> queue;
+    FtxHandler handler;
+    std::vector<size_t> sampled;  // indices into `markets`
+    std::vector<float> samples;   // [grid, sampled market, level, field]
+    std::thread thread;
+  };
+  std::vector<std::unique_ptr<Worker>> workers;
+  for (size_t i = 0; i < threads; ++i) {
+    workers.push_back(std::make_unique<Worker>(queueCapacity));
+  }
+
+  struct Owner {
+    size_t worker;
+    bool seen;
+  };
+  std::map<std::string, Owner, std::less<>> owners;
+  std::vector<std::string> order;  // first appearance in the capture
+  size_t dealt = 0;
+  for (size_t i = 0; i < markets.size(); ++i) {
+    auto [it, inserted] =
+        owners.emplace(markets[i], Owner{dealt % threads, false});
+    if (inserted) {
+      ++dealt;
+    }
+    workers[it->second.worker]->sampled.push_back(i);
+  }
+
+  const size_t marketSize = depth * BookSampler::kNumFields;
+  std::atomic<bool> done{false};
+  std::atomic<bool> failed{false};
+  std::exception_ptr error;
+  std::mutex errorMutex;
+  for (auto& w : workers) {
+    if (!w->sampled.empty()) {
+      std::vector<std::string> names;
+      for (const auto i : w->sampled) {
+        names.push_back(markets[i]);
+      }
+      w->samples.resize(grid.size() * names.size() * marketSize);
+      w->handler.attachSampler(names, depth, grid, w->samples.data());
+    }
+    w->thread = std::thread([&, w = w.get()] {
+      try {
+        std::string_view line;
+        for (;;) {
+          if (w->queue.pop(line)) {
+            w->handler.onPadded(line);
+          } else if (done.load(std::memory_order_acquire)) {
+            if (!w->queue.pop(line)) {
+              break;
+            }
+            w->handler.onPadded(line);
+          } else {
+            std::this_thread::yield();
+          }
+        }
+        if (auto* sampler = w->handler.getSampler()) {
+          sampler->flush();
+        }
+      } catch (...) {
+        std::lock_guard lock(errorMutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+        failed = true;
+      }
+    });
+  }
+
+  size_t n = 0;
+  try {
+    std::string_view line;
+    while (!failed && reader.next(line)) {
+      const auto market = io::scanString(line, "market");
+      if (market.empty()) {
+        continue;
+      }
+      auto it = owners.find(market);
+      if (it == owners.end()) {
+        it = owners.emplace(market, Owner{dealt++ % threads, false}).first;
+      }
+      if (!it->second.seen) {
+        it->second.seen = true;
+        order.emplace_back(market);
+      }
+      auto& queue = workers[it->second.worker]->queue;
+      while (!queue.push(std::string_view(line)) && !failed) {
+        std::this_thread::yield();
+      }
+      ++n;
+    }
+  } catch (...) {
+    std::lock_guard lock(errorMutex);
+    if (!error) {
+      error = std::current_exception();
+    }
+  }
+  done.store(true, std::memory_order_release);
+  for (auto& w : workers) {
+    w->thread.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+
+  for (const auto& w : workers) {
+    for (size_t j = 0; j < w->sampled.size(); ++j) {
+      for (size_t r = 0; r < grid.size(); ++r) {
+        std::memcpy(out + (r * markets.size() + w->sampled[j]) * marketSize,
+                    w->samples.data() +
+                        (r * w->sampled.size() + j) * marketSize,
+                    marketSize * sizeof(float));
+      }
+    }
+  }
+  if (merged) {
+    merged->reset();
+    for (const auto& market : order) {
+      auto& handler = workers[owners.find(market)->second.worker]->handler;
+      merged->getBook(market) = std::move(handler.getBook(market));
+    }
+    for (const auto& w : workers) {
+      merged->lastTs = std::max(merged->lastTs, w->handler.lastTs);
+      for (const auto& [ccy, qty] : w->handler.balances) {
+        merged->getBalance(ccy) += qty;
+      }
+    }
+  }
+  return n;
+}
+
+}  // namespace ngh::mkt
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <cmath>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "ngh/io/scan.h"
+#include "ngh/mkt/captureindex.h"
+#include "ngh/mkt/ftxhandler.h"
+#include "ngh/mkt/sampler.h"
+
+namespace ngh::mkt {
+
+// Sources provide `bool next(std::string_view&)` returning lines followed by
+// at least SIMDJSON_PADDING readable bytes, which are parsed in place.
+
+// Applies every line of `source` to `handler`; returns the number of lines.
+template <typename Source>
+size_t replayAll(Source& source, FtxHandler& handler) {
+  size_t n = 0;
+  std::string_view line;
+  while (source.next(line)) {
+    handler.onPadded(line);
+    ++n;
+  }
+  return n;
+}
+
+// Rebuilds `handler` as of event time `ts` by entering a seekable `source`
+// at the range from `index` (see CaptureIndex::seekRange) rather than its
+// start. `pending` is set to the first line past `ts`, not yet applied (empty
+// at the end of the source). Returns the number of lines applied.
+template <typename Source>
+size_t seekReplay(Source& source, FtxHandler& handler,
+                  const CaptureIndex& index, const double ts,
+                  const std::vector<std::string>& markets,
+                  std::string_view& pending) {
+  const auto [from, to] = index.seekRange(ts, markets);
+  handler.reset();
+  source.seek(from);
+  size_t n = 0;
+  pending = {};
+  std::string_view line;
+  while (source.next(line)) {
+    if (source.tell() > to && io::scanTime(line) > ts) {
+      pending = line;
+      break;
+    }
+    handler.onPadded(line);
+    ++n;
+  }
+  return n;
+}
+
+// Pull driven replay of a line source into an FtxHandler that stops at sample
+// points, either every `interval` seconds of orderbook event time or every
+// `events` messages. At each stop the top `depth` levels of `markets` are in
+// snapshot() as [market, level, field] (see BookSampler), valid until the
+// following next().
+//
+// A time sample at grid time g holds the state as of the last event at or
+// before g; when several grid points pass without events only the last one
+// is reported.
+template <typename Source>
+class Replayer {
+ public:
+  Replayer(const std::string& path, const std::vector<std::string>& markets,
+           const size_t depth, const double interval, const size_t events)
+      : source_(path),
+        depth_(depth),
+        interval_(interval),
+        events_(events),
+        snapshot_(markets.size() * depth * BookSampler::kNumFields),
+        markets_(markets) {
+    getBooks();
+  }
+  Replayer(const Replayer&) = delete;
+  Replayer& operator=(const Replayer&) = delete;
+
+  // Advances to the next sample point; false once the source is exhausted.
+  bool next() {
+    if (!pending_.empty()) {
+      if (std::exchange(unchecked_, false) && interval_ > 0. &&
+          crossed(pending_)) {
+        return true;
+      }
+      apply(pending_);
+      pending_ = {};
+    }
+    std::string_view line;
+    while (source_.next(line)) {
+      if (interval_ > 0. && crossed(line)) {
+        pending_ = line;  // applied after the caller is done with the sample
+        return true;
+      }
+      apply(line);
+      if (events_ && count_ % events_ == 0) {
+        ts_ = handler_.lastTs;
+        snap();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Restarts the replay at event time `ts` with state rebuilt through
+  // `index`; the next time sample is the first grid point past `ts`.
+  void seek(const CaptureIndex& index, const double ts) {
+    seekReplay(source_, handler_, index, ts, markets_, pending_);
+    unchecked_ = true;
+    getBooks();  // reset() dropped them
+    count_ = 0;
+    ts_ = ts;
+    next_ = interval_ > 0. ? (std::floor(ts / interval_) + 1) * interval_ : NAN;
+  }
+
+  double ts() const { return ts_; }
+  size_t count() const { return count_; }
+  size_t depth() const { return depth_; }
+  size_t numMarkets() const { return books_.size(); }
+  const std::vector<float>& snapshot() const { return snapshot_; }
+  FtxHandler& handler() { return handler_; }
+
+ private:
+  void apply(const std::string_view line) {
+    handler_.onPadded(line);
+    ++count_;
+  }
+
+  // True (with the sample taken) if `line` moves event time past the next
+  // grid point.
+  bool crossed(const std::string_view line) {
+    const double t = io::scanTime(line);
+    if (std::isnan(t)) {
+      return false;
+    }
+    if (std::isnan(next_)) {
+      next_ = (std::floor(t / interval_) + 1) * interval_;
+      return false;
+    }
+    if (t <= next_) {
+      return false;
+    }
+    // grid points as multiples of interval_, so they don't drift and match
+    // after a seek()
+    const double k = std::ceil(t / interval_) - 1;
+    ts_ = k * interval_;
+    next_ = (k + 1) * interval_;
+    snap();
+    return true;
+  }
+
+  void getBooks() {
+    books_.clear();
+    for (const auto& m : markets_) {
+      books_.push_back(&handler_.getBook(m));
+    }
+  }
+
+  void snap() {
+    float* out = snapshot_.data();
+    for (const auto* book : books_) {
+      BookSampler::writeBook(*book, depth_, out);
+      out += depth_ * BookSampler::kNumFields;
+    }
+  }
+
+  Source source_;
+  FtxHandler handler_;
+  std::vector<const L2StateTracker*> books_;
+  size_t depth_;
+  double interval_;
+  size_t events_;
+  std::vector<float> snapshot_;
+  std::vector<std::string> markets_;
+  std::string_view pending_;
+  double next_{NAN};
+  double ts_{NAN};
+  size_t count_{0};
+  bool unchecked_{false};  // pending_ left by seek() may cross the grid
+};
+
+}  // namespace ngh::mkt
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstring>
+#include <vector>
+
+#include "ngh/mkt/l2statetracker.h"
+
+namespace ngh::mkt {
+
+// Samples the top `depth` levels of a set of books on an event time grid into
+// a caller owned float32 tensor laid out as [time, market, level, field].
+// Missing levels are written as NaN price and zero qty.
+class BookSampler {
+ public:
+  enum Field : size_t { kBidPx = 0, kBidQty, kAskPx, kAskQty, kNumFields };
+
+  BookSampler(std::vector<const L2StateTracker*> books, const size_t depth,
+              std::vector<double> grid, float* out)
+      : books_(std::move(books)),
+        depth_(depth),
+        rowSize_(books_.size() * depth * kNumFields),
+        grid_(std::move(grid)),
+        out_(out) {}
+
+  // Emits every grid point strictly before `ts`, i.e. the state as of the
+  // last event at or before each grid time. Called before `ts` is applied.
+  void advance(const double ts) {
+    if (next_ == grid_.size() || grid_[next_] >= ts) {
+      return;
+    }
+    emit();
+    // nothing changed in between, so the remaining rows are copies
+    for (; next_ < grid_.size() && grid_[next_] < ts; ++next_) {
+      std::memcpy(row(next_), row(next_ - 1), rowSize_ * sizeof(float));
+    }
+  }
+
+  // Emits all remaining grid points with the current state.
+  void flush() { advance(INFINITY); }
+
+  size_t rows() const { return next_; }
+  size_t rowSize() const { return rowSize_; }
+  size_t depth() const { return depth_; }
+  const std::vector<double>& grid() const { return grid_; }
+
+  // Writes `depth` levels of `book` as [level, field] into `out`.
+  static void writeBook(const L2StateTracker& book, const size_t depth,
+                        float* out) {
+    auto bid = book.levels[0].begin();
+    auto ask = book.levels[1].begin();
+    for (size_t i = 0; i < depth; ++i, out += kNumFields) {
+      if (bid != book.levels[0].end()) {
+        out[kBidPx] = -bid->first;  // bids are keyed by negated price
+        out[kBidQty] = bid->second;
+        ++bid;
+      } else {
+        out[kBidPx] = NAN;
+        out[kBidQty] = 0.f;
+      }
+      if (ask != book.levels[1].end()) {
+        out[kAskPx] = ask->first;
+        out[kAskQty] = ask->second;
+        ++ask;
+      } else {
+        out[kAskPx] = NAN;
+        out[kAskQty] = 0.f;
+      }
+    }
+  }
+
+ private:
+  float* row(const size_t i) { return out_ + i * rowSize_; }
+
+  void emit() {
+    float* out = row(next_++);
+    for (const auto* book : books_) {
+      writeBook(*book, depth_, out);
+      out += depth_ * kNumFields;
+    }
+  }
+
+  std::vector<const L2StateTracker*> books_;
+  size_t depth_;
+  size_t rowSize_;
+  std::vector<double> grid_;
+  float* out_;
+  size_t next_{0};
+};
+
+}  // namespace ngh::mkt
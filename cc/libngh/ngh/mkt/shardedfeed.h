@@ -0,0 +1,197 @@
+#pragma once
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ngh/io/scan.h"
+#include "ngh/mkt/feed.h"
+#include "ngh/mkt/ftxhandler.h"
+
+namespace ngh::mkt {
+
+// Live feed split over several connections, each applied by its own
+// FeedThread into its own FtxHandler, for when one connection and one core
+// can't keep up with every market. Market subscriptions are dealt round
+// robin over up to `numShards` market shards; subscriptions without a
+// market (fills, orders, login) go to one more, account shard, so account
+// updates never queue behind book updates.
+//
+// The read side hides the split: fd() is readable whenever any shard has
+// published, ack() acks them all, and getTop() finds the shard of a market.
+// As for a single feed, it is meant for one reader thread, and the shard
+// handlers may only be read directly after stop(). The account shard keeps
+// its own books for fills and orders; market shards' books don't have them.
+class ShardedFeed {
+ public:
+  using Shard = FeedThread<FtxHandler>;
+
+  ShardedFeed(const std::string& host, const uint16_t port,
+              const std::string& path,
+              const std::vector<std::string>& subscriptions,
+              const size_t numShards, const size_t maxMarkets,
+              const FeedConfig& config) {
+    if (numShards == 0) {
+      throw std::invalid_argument("at least one shard is required");
+    }
+    std::vector<std::vector<std::string>> subs;
+    std::vector<std::string> account;
+    for (const auto& sub : subscriptions) {
+      const auto market = io::scanString(sub, "market");
+      if (market.empty()) {
+        account.push_back(sub);
+        continue;
+      }
+      auto it = route_.find(market);
+      if (it == route_.end()) {
+        const auto n = route_.size();
+        if (n < numShards) {
+          subs.emplace_back();
+        }
+        it = route_.emplace(market, n % numShards).first;
+      }
+      subs[it->second].push_back(sub);
+    }
+    if (!account.empty()) {
+      account_ = int(subs.size());
+      subs.push_back(std::move(account));
+    }
+
+    // consecutive cpus from config.cpu, if pinned, all checked before
+    // connecting
+    if (config.cpu >= 0) {
+      for (size_t i = 0; i < subs.size(); ++i) {
+        util::checkCpu(config.cpu + int(i));
+      }
+    }
+    for (size_t i = 0; i < subs.size(); ++i) {
+      auto shardConfig = config;
+      if (config.cpu >= 0) {
+        shardConfig.cpu = config.cpu + int(i);
+      }
+      handlers_.push_back(std::make_unique<FtxHandler>());
+      shards_.push_back(std::make_unique<Shard>(
+          *handlers_.back(), net::TcpTransport(host, port), host, path,
+          subs[i], maxMarkets, shardConfig));
+    }
+    ids_.resize(shards_.size());
+    seen_.resize(shards_.size());
+
+    epollFd_ = ::epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd_ < 0) {
+      throw std::runtime_error(std::string("epoll_create1 failed: ") +
+                               std::strerror(errno));
+    }
+    for (const auto& shard : shards_) {
+      epoll_event ev{};
+      ev.events = EPOLLIN;
+      ev.data.fd = shard->fd();
+      if (::epoll_ctl(epollFd_, EPOLL_CTL_ADD, shard->fd(), &ev) != 0) {
+        const int err = errno;
+        ::close(epollFd_);
+        throw std::runtime_error(std::string("epoll_ctl failed: ") +
+                                 std::strerror(err));
+      }
+    }
+  }
+  ShardedFeed(const ShardedFeed&) = delete;
+  ShardedFeed& operator=(const ShardedFeed&) = delete;
+  ~ShardedFeed() {
+    stop();
+    ::close(epollFd_);
+  }
+
+  // Stops every shard, after which the handlers may be read.
+  void stop() {
+    for (auto& shard : shards_) {
+      shard->stop();
+    }
+  }
+
+  // Reader side, see TopPublisher.
+  int fd() const { return epollFd_; }
+  void ack() {
+    for (auto& shard : shards_) {
+      shard->ack();
+    }
+  }
+
+  // Last published top of `market`; false if it is not subscribed or has
+  // not been seen yet.
+  bool getTop(const std::string_view market, TopOfBook& out) {
+    const int i = shardOf(market);
+    if (i < 0) {
+      return false;
+    }
+    auto& shard = *shards_[i];
+    auto& ids = ids_[i];
+    for (auto& n = seen_[i]; n < shard.numMarkets(); ++n) {
+      ids.emplace(shard.getMarket(n), n);
+    }
+    const auto it = ids.find(market);
+    return it != ids.end() && shard.getTop(it->second, out);
+  }
+
+  // subscribed markets, sorted
+  std::vector<std::string> getMarkets() const {
+    std::vector<std::string> out;
+    out.reserve(route_.size());
+    for (const auto& [market, shard] : route_) {
+      out.push_back(market);
+    }
+    return out;
+  }
+  // Shard applying `market`, -1 if it is not subscribed.
+  int shardOf(const std::string_view market) const {
+    const auto it = route_.find(market);
+    return it == route_.end() ? -1 : int(it->second);
+  }
+  // The account shard, -1 if there were no account subscriptions.
+  int accountShard() const { return account_; }
+
+  size_t numShards() const { return shards_.size(); }
+  Shard& shard(const size_t i) { return *shards_.at(i); }
+  FtxHandler& handler(const size_t i) { return *handlers_.at(i); }
+
+  // Book of `market` in the shard applying it; only after stop().
+  L2StateTracker& getBook(const std::string_view market) {
+    const int i = shardOf(market);
+    if (i < 0) {
+      throw std::invalid_argument("market " + std::string(market) +
+                                  " is not subscribed");
+    }
+    return handlers_[i]->getBook(market);
+  }
+
+  // true while every shard is connected
+  bool running() const {
+    for (const auto& shard : shards_) {
+      if (!shard->running()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  std::map<std::string, size_t, std::less<>> route_;  // market -> shard
+  int account_{-1};
+  // handlers first, so the threads applying to them stop before they go
+  std::vector<std::unique_ptr<FtxHandler>> handlers_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+  // reader side: name -> id in each shard, of the first seen_ markets
+  std::vector<std::map<std::string, MarketId, std::less<>>> ids_;
+  std::vector<MarketId> seen_;
+  int epollFd_{-1};
+};
+
+}  // namespace ngh::mkt
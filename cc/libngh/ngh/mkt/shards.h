@@ -0,0 +1,299 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "ngh/io/capturereader.h"
+#include "ngh/io/file.h"
+#include "ngh/io/mmapreader.h"
+#include "ngh/io/scan.h"
+#include "ngh/io/varint.h"
+#include "ngh/mkt/ftxstate.h"
+
+namespace ngh::mkt {
+
+// A capture rewritten as one uncompressed shard per market, plus an account
+// shard with the fills and orders channels, so a replay of a few markets
+// reads and parses only their lines. Every shard "<n>.ndjson" has a
+// "<n>.ndjson.seq" sidecar with the capture line number of each of its lines
+// (varint deltas), which lets ShardReader merge any subset back into capture
+// order exactly. The directory's "manifest" lists the shards.
+struct ShardManifest {
+  static constexpr uint32_t kMagic = 0x4452484e;  // "NHRD"
+  static constexpr uint32_t kVersion = 1;
+
+  struct Shard {
+    std::string file;  // relative to the directory
+    uint64_t lines{0};
+    uint64_t bytes{0};
+  };
+
+  std::string source;
+  uint64_t lines{0};    // of the source
+  uint64_t skipped{0};  // lines with neither market nor account channel
+  std::map<std::string, Shard, std::less<>> markets;
+  Shard account;
+
+  static std::string path(const std::string& dir) { return dir + "/manifest"; }
+
+  // Shard paths of the markets in `names` (all of them when empty), then of
+  // the account shard if `withAccount`.
+  std::vector<std::string> files(const std::string& dir,
+                                 const std::vector<std::string>& names,
+                                 const bool withAccount) const {
+    std::vector<std::string> out;
+    if (names.empty()) {
+      for (const auto& [market, shard] : markets) {
+        out.push_back(dir + "/" + shard.file);
+      }
+    }
+    for (const auto& market : names) {
+      auto it = markets.find(market);
+      if (it == markets.end()) {
+        throw std::invalid_argument("no shard for market " + market);
+      }
+      out.push_back(dir + "/" + it->second.file);
+    }
+    if (withAccount) {
+      out.push_back(dir + "/" + account.file);
+    }
+    return out;
+  }
+
+  void save(const std::string& dir) const {
+    std::string out;
+    state::Writer w(out);
+    w.put(kMagic);
+    w.put(kVersion);
+    w.putStr(source);
+    w.put(lines);
+    w.put(skipped);
+    const auto put = [&w](const Shard& s) {
+      w.putStr(s.file);
+      w.put(s.lines);
+      w.put(s.bytes);
+    };
+    put(account);
+    w.put(uint32_t(markets.size()));
+    for (const auto& [market, shard] : markets) {
+      w.putStr(market);
+      put(shard);
+    }
+    io::writeFile(path(dir), out);
+  }
+
+  static ShardManifest load(const std::string& dir) {
+    const auto in = io::readFile(path(dir));
+    state::Reader r(in, "truncated shard manifest");
+    if (r.get<uint32_t>() != kMagic || r.get<uint32_t>() != kVersion) {
+      throw std::runtime_error(path(dir) + " is not a shard manifest");
+    }
+    ShardManifest m;
+    m.source = r.str();
+    m.lines = r.get<uint64_t>();
+    m.skipped = r.get<uint64_t>();
+    const auto get = [&r](Shard& s) {
+      s.file = r.str();
+      s.lines = r.get<uint64_t>();
+      s.bytes = r.get<uint64_t>();
+    };
+    get(m.account);
+    const auto n = r.get<uint32_t>();
+    for (uint32_t i = 0; i < n; ++i) {
+      const auto market = r.str();
+      get(m.markets[std::string(market)]);
+    }
+    return m;
+  }
+};
+
+namespace detail {
+
+// Appends to a shard and its sidecar in large writes; files are opened per
+// write, so a thousand markets don't need a thousand descriptors.
+class ShardWriter {
+ public:
+  static constexpr size_t kFlushSize = 1 << 16;
+
+  explicit ShardWriter(std::string path) : path_(std::move(path)) {}
+
+  void add(const std::string_view line, const uint64_t seq,
+           ShardManifest::Shard& stats) {
+    data_.append(line);
+    data_.push_back('\n');
+    io::putVarint(seqs_, seq - last_);
+    last_ = seq;
+    ++stats.lines;
+    stats.bytes += line.size() + 1;
+    if (data_.size() >= kFlushSize) {
+      flush();
+    }
+  }
+
+  void flush() {
+    append(path_, data_);
+    append(path_ + ".seq", seqs_);
+    data_.clear();
+    seqs_.clear();
+    created_ = true;
+  }
+
+ private:
+  void append(const std::string& path, const std::string& data) const {
+    const int fd = ::open(path.c_str(),
+                          O_WRONLY | O_CREAT | (created_ ? O_APPEND : O_TRUNC),
+                          0644);
+    if (fd < 0) {
+      throw std::runtime_error("failed to open " + path + ": " +
+                               std::strerror(errno));
+    }
+    std::string_view rest = data;
+    while (!rest.empty()) {
+      const ssize_t n = ::write(fd, rest.data(), rest.size());
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n < 0) {
+        ::close(fd);
+        throw std::runtime_error("failed to write " + path + ": " +
+                                 std::strerror(errno));
+      }
+      rest.remove_prefix(n);
+    }
+    ::close(fd);
+  }
+
+  std::string path_;
+  std::string data_;
+  std::string seqs_;
+  uint64_t last_{0};
+  bool created_{false};
+};
+
+}  // namespace detail
+
+// Splits `capture` (plain or gzip) into shards under `dir`, created if
+// needed, and saves the manifest last; existing shards are overwritten.
+// Lines are routed with the cheap scanners, no json parsing: the fills and
+// orders channels go to the account shard, anything else with a "market" to
+// the shard of that market.
+inline ShardManifest splitCapture(const std::string& capture,
+                                  const std::string& dir) {
+  if (::mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+    throw std::runtime_error("failed to create " + dir + ": " +
+                             std::strerror(errno));
+  }
+  ShardManifest manifest;
+  manifest.source = capture;
+  manifest.account.file = "account.ndjson";
+  detail::ShardWriter account(dir + "/" + manifest.account.file);
+  std::map<std::string, detail::ShardWriter, std::less<>> writers;
+
+  io::CaptureReader reader(capture);
+  std::string_view line;
+  uint64_t seq = 0;
+  for (; reader.next(line); ++seq) {
+    const auto channel = io::scanString(line, "channel");
+    if (channel == "fills" || channel == "orders") {
+      account.add(line, seq, manifest.account);
+      continue;
+    }
+    const auto market = io::scanString(line, "market");
+    if (market.empty()) {
+      ++manifest.skipped;
+      continue;
+    }
+    auto it = manifest.markets.find(market);
+    if (it == manifest.markets.end()) {
+      char file[32];
+      std::snprintf(file, sizeof(file), "%06zu.ndjson",
+                    manifest.markets.size());
+      it = manifest.markets.emplace(market, ShardManifest::Shard{file}).first;
+      writers.emplace(market, detail::ShardWriter(dir + "/" + file));
+    }
+    writers.find(market)->second.add(line, seq, it->second);
+  }
+  manifest.lines = seq;
+  account.flush();
+  for (auto& [market, writer] : writers) {
+    writer.flush();
+  }
+  manifest.save(dir);
+  return manifest;
+}
+
+// Line source over some shards of a split capture, merged back into capture
+// order by their sequence sidecars; lines are views into the mapped shards,
+// padded for in-place parsing, and valid until the following next().
+class ShardReader {
+ public:
+  ShardReader(const std::string& dir, const std::vector<std::string>& markets,
+              const bool withAccount = true) {
+    const auto manifest = ShardManifest::load(dir);
+    for (const auto& path : manifest.files(dir, markets, withAccount)) {
+      sources_.emplace_back(path);
+    }
+    for (size_t i = 0; i < sources_.size(); ++i) {
+      advance(i);
+    }
+  }
+
+  bool next(std::string_view& line) {
+    if (last_ < sources_.size()) {
+      advance(last_);
+    }
+    if (heap_.empty()) {
+      last_ = sources_.size();
+      return false;
+    }
+    last_ = heap_.top().second;
+    heap_.pop();
+    line = sources_[last_].line;
+    return true;
+  }
+
+  size_t numShards() const { return sources_.size(); }
+
+ private:
+  struct Source {
+    explicit Source(const std::string& path)
+        : reader(path), seqs(io::readFile(path + ".seq")) {
+      pos = seqs.data();
+    }
+    io::MmapLineReader reader;
+    std::string seqs;
+    const char* pos;
+    uint64_t seq{0};
+    std::string_view line;
+  };
+  using Entry = std::pair<uint64_t, size_t>;  // (capture line, source)
+
+  void advance(const size_t i) {
+    auto& s = sources_[i];
+    if (!s.reader.next(s.line)) {
+      return;
+    }
+    s.seq += io::getVarint(s.pos, s.seqs.data() + s.seqs.size());
+    heap_.emplace(s.seq, i);
+  }
+
+  std::deque<Source> sources_;  // stable, `pos` points into `seqs`
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<>> heap_;
+  size_t last_{SIZE_MAX};
+};
+
+}  // namespace ngh::mkt
@@ -0,0 +1,419 @@
+#pragma once
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "simdjson.h"
+
+namespace ngh::net {
+
+// Plain TCP transport, for local stand-ins of an exchange (replayserver) and
+// anything behind a TLS terminating proxy. A transport owns a connected
+// socket and exposes fd(), read() and write() with recv()/send() semantics
+// (-1 with errno EAGAIN once a non-blocking socket is drained); a TLS layer
+// slots in by wrapping its session the same way.
+class TcpTransport {
+ public:
+  TcpTransport(const std::string& host, const uint16_t port) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* found = nullptr;
+    const auto service = std::to_string(port);
+    if (const int rc =
+            ::getaddrinfo(host.c_str(), service.c_str(), &hints, &found)) {
+      throw std::runtime_error("failed to resolve " + host + ": " +
+                               ::gai_strerror(rc));
+    }
+    int err = 0;
+    for (auto* ai = found; ai && fd_ < 0; ai = ai->ai_next) {
+      fd_ = ::socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC,
+                     ai->ai_protocol);
+      if (fd_ >= 0 && ::connect(fd_, ai->ai_addr, ai->ai_addrlen) != 0) {
+        err = errno;
+        ::close(std::exchange(fd_, -1));
+      }
+    }
+    ::freeaddrinfo(found);
+    if (fd_ < 0) {
+      throw std::runtime_error("failed to connect to " + host + ":" +
+                               std::to_string(port) + ": " +
+                               std::strerror(err));
+    }
+    const int one = 1;
+    ::setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+  TcpTransport(TcpTransport&& o) noexcept : fd_(std::exchange(o.fd_, -1)) {}
+  TcpTransport(const TcpTransport&) = delete;
+  TcpTransport& operator=(const TcpTransport&) = delete;
+  ~TcpTransport() {
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+
+  int fd() const { return fd_; }
+  ssize_t read(void* buf, const size_t n) { return ::recv(fd_, buf, n, 0); }
+  ssize_t write(const void* buf, const size_t n) {
+    return ::send(fd_, buf, n, MSG_NOSIGNAL);
+  }
+
+ private:
+  int fd_{-1};
+};
+
+// Client side of RFC 6455 over a Transport, made for an event loop: the
+// handshake is done blocking in the constructor, after which the socket is
+// non-blocking and poll() decodes whatever has arrived.
+//
+// Messages are handed out as views into the receive buffer, followed by at
+// least SIMDJSON_PADDING readable bytes so they can be parsed in place
+// (FtxHandler::onPadded); fragmented messages are reassembled into a padded
+// copy. Messages longer than `maxMessage` are skipped as they arrive, without
+// buffering them, and counted. Pings are answered from poll(). The server's
+// Sec-WebSocket-Accept is not verified.
+template <typename Transport = TcpTransport>
+class WebSocketClient {
+ public:
+  enum Opcode : uint8_t {
+    kContinuation = 0,
+    kText = 1,
+    kBinary = 2,
+    kClose = 8,
+    kPing = 9,
+    kPong = 10,
+  };
+  static constexpr size_t kPadding = simdjson::SIMDJSON_PADDING;
+  static constexpr size_t kReadSize = 64 << 10;
+  static constexpr size_t kMaxMessage = 64 << 20;
+
+  WebSocketClient(Transport transport, const std::string& host,
+                  const std::string& path,
+                  const size_t maxMessage = kMaxMessage)
+      : transport_(std::move(transport)),
+        buf_(2 * kReadSize + kPadding),
+        maxMessage_(maxMessage) {
+    handshake(host, path);
+    const int fd = transport_.fd();
+    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+  }
+  WebSocketClient(const WebSocketClient&) = delete;
+  WebSocketClient& operator=(const WebSocketClient&) = delete;
+
+  int fd() const { return transport_.fd(); }
+  bool open() const { return open_; }
+
+  // Reads until the socket is drained, calling `onMessage(view)` for every
+  // complete text or binary message; false once the connection is closed.
+  template <typename F>
+  bool poll(F&& onMessage) {
+    parse(onMessage);  // frames that came with the handshake response
+    while (open_) {
+      reserve(kReadSize);
+      const ssize_t n = transport_.read(buf_.data() + end_,
+                                        buf_.size() - kPadding - end_);
+      if (n > 0) {
+        end_ += size_t(n);
+        bytes_ += size_t(n);
+        parse(onMessage);
+      } else if (n == 0) {
+        open_ = false;
+      } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return true;
+      } else if (errno != EINTR) {
+        throw std::runtime_error(std::string("websocket read failed: ") +
+                                 std::strerror(errno));
+      }
+    }
+    return false;
+  }
+
+  // Sends a masked frame, waiting for the socket if it is full.
+  void send(const std::string_view payload, const Opcode opcode = kText) {
+    std::string frame;
+    frame.reserve(payload.size() + 14);
+    frame.push_back(char(0x80 | opcode));
+    if (payload.size() < 126) {
+      frame.push_back(char(0x80 | payload.size()));
+    } else if (payload.size() <= UINT16_MAX) {
+      frame.push_back(char(0x80 | 126));
+      for (int shift = 8; shift >= 0; shift -= 8) {
+        frame.push_back(char(payload.size() >> shift));
+      }
+    } else {
+      frame.push_back(char(0x80 | 127));
+      for (int shift = 56; shift >= 0; shift -= 8) {
+        frame.push_back(char(uint64_t(payload.size()) >> shift));
+      }
+    }
+    const uint32_t key = uint32_t(rng_());
+    char mask[4];
+    std::memcpy(mask, &key, sizeof(mask));
+    frame.append(mask, sizeof(mask));
+    for (size_t i = 0; i < payload.size(); ++i) {
+      frame.push_back(char(payload[i] ^ mask[i & 3]));
+    }
+    writeAll(frame);
+  }
+
+  // Starts the closing handshake; poll() returns false once it is done.
+  void close() {
+    if (!closeSent_) {
+      closeSent_ = true;
+      send({}, kClose);
+    }
+  }
+
+  uint64_t bytes() const { return bytes_; }
+  uint64_t messages() const { return messages_; }
+  // messages longer than maxMessage, not handed out
+  uint64_t skipped() const { return skipped_; }
+
+ private:
+  void handshake(const std::string& host, const std::string& path) {
+    unsigned char nonce[16];
+    for (auto& b : nonce) {
+      b = uint8_t(rng_());
+    }
+    writeAll("GET " + path + " HTTP/1.1\r\nHost: " + host +
+             "\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+             "Sec-WebSocket-Key: " +
+             base64(nonce, sizeof(nonce)) +
+             "\r\nSec-WebSocket-Version: 13\r\n\r\n");
+    std::string_view response;
+    for (;;) {
+      const ssize_t n = transport_.read(buf_.data() + end_,
+                                        buf_.size() - kPadding - end_);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        throw std::runtime_error("websocket handshake failed: connection " +
+                                 std::string(n == 0 ? "closed" : "error"));
+      }
+      end_ += size_t(n);
+      response = {buf_.data(), end_};
+      if (const auto eoh = response.find("\r\n\r\n");
+          eoh != std::string_view::npos) {
+        begin_ = eoh + 4;
+        response = response.substr(0, eoh);
+        break;
+      }
+      if (end_ + kPadding == buf_.size()) {
+        throw std::runtime_error("websocket handshake failed: no response");
+      }
+    }
+    if (!response.starts_with("HTTP/1.1 101")) {
+      throw std::runtime_error(
+          "websocket handshake failed: " +
+          std::string(response.substr(0, response.find("\r\n"))));
+    }
+    open_ = true;
+  }
+
+  // Keeps `n` bytes (and the padding) free after the data.
+  void reserve(const size_t n) {
+    if (buf_.size() - kPadding - end_ >= n) {
+      return;
+    }
+    if (begin_) {
+      std::memmove(buf_.data(), buf_.data() + begin_, end_ - begin_);
+      end_ -= begin_;
+      begin_ = 0;
+    }
+    if (buf_.size() - kPadding - end_ < n) {
+      buf_.resize(std::max(2 * buf_.size(), end_ + n + kPadding));
+    }
+  }
+
+  template <typename F>
+  void parse(F& onMessage) {
+    while (open_) {
+      if (skip_) {  // payload of a message too long to hand out
+        const auto n = std::min<uint64_t>(skip_, end_ - begin_);
+        begin_ += n;
+        skip_ -= n;
+        if (skip_) {
+          break;
+        }
+      }
+      const size_t avail = end_ - begin_;
+      if (avail < 2) {
+        break;
+      }
+      auto* p = reinterpret_cast<uint8_t*>(buf_.data() + begin_);
+      const bool fin = p[0] & 0x80;
+      const auto opcode = Opcode(p[0] & 0x0f);
+      const bool masked = p[1] & 0x80;
+      uint64_t len = p[1] & 0x7f;
+      size_t header = 2;
+      if (len >= 126) {
+        const size_t bytes = len == 126 ? 2 : 8;
+        if (avail < header + bytes) {
+          return;
+        }
+        len = 0;
+        for (size_t i = 0; i < bytes; ++i) {
+          len = (len << 8) | p[header + i];
+        }
+        header += bytes;
+      }
+      const size_t maskAt = header;
+      header += masked ? 4 : 0;
+      if (avail < header) {
+        return;
+      }
+      if (tooLong(opcode, len)) {
+        begin_ += header;
+        skip_ = len;
+        skipping_ = !fin;
+        continue;
+      }
+      if (len > maxMessage_) {  // a control frame, meant to be short
+        throw std::runtime_error("websocket frame too large");
+      }
+      if (avail < header + len) {
+        reserve(header + len - avail);  // the frame is still coming
+        return;
+      }
+      char* payload = buf_.data() + begin_ + header;
+      if (masked) {  // servers don't, but be lenient
+        for (size_t i = 0; i < len; ++i) {
+          payload[i] ^= char(p[maskAt + (i & 3)]);
+        }
+      }
+      begin_ += header + len;
+      dispatch(fin, opcode, {payload, size_t(len)}, onMessage);
+    }
+    if (begin_ == end_) {
+      begin_ = end_ = 0;
+    }
+  }
+
+  // True for the data frames of a message longer than maxMessage_, which
+  // are dropped; the message is counted at the frame that makes it too long.
+  bool tooLong(const Opcode opcode, const uint64_t len) {
+    uint64_t total = len;
+    if (opcode == kContinuation) {
+      if (skipping_) {
+        return true;
+      }
+      total += message_.size();
+    } else if (opcode == kText || opcode == kBinary) {
+      skipping_ = false;
+    } else {
+      return false;
+    }
+    if (total <= maxMessage_) {
+      return false;
+    }
+    ++skipped_;
+    fragmented_ = false;
+    message_.clear();
+    return true;
+  }
+
+  template <typename F>
+  void dispatch(const bool fin, const Opcode opcode,
+                const std::string_view payload, F& onMessage) {
+    switch (opcode) {
+      case kText:
+      case kBinary:
+        if (fin) {
+          ++messages_;
+          onMessage(payload);
+        } else {
+          message_.assign(payload);
+          fragmented_ = true;
+        }
+        break;
+      case kContinuation:
+        if (!fragmented_) {
+          throw std::runtime_error("unexpected websocket continuation");
+        }
+        message_.append(payload);
+        if (fin) {
+          fragmented_ = false;
+          message_.reserve(message_.size() + kPadding);
+          ++messages_;
+          onMessage(std::string_view(message_));
+        }
+        break;
+      case kPing:
+        send(payload, kPong);
+        break;
+      case kClose:
+        close();
+        open_ = false;
+        break;
+      default:
+        break;
+    }
+  }
+
+  void writeAll(const std::string_view data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+      const ssize_t n =
+          transport_.write(data.data() + sent, data.size() - sent);
+      if (n > 0) {
+        sent += size_t(n);
+      } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        pollfd pfd{transport_.fd(), POLLOUT, 0};
+        ::poll(&pfd, 1, 1000);
+      } else if (n < 0 && errno != EINTR) {
+        throw std::runtime_error(std::string("websocket write failed: ") +
+                                 std::strerror(errno));
+      }
+    }
+  }
+
+  static std::string base64(const unsigned char* data, const size_t n) {
+    static constexpr char kChars[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    for (size_t i = 0; i < n; i += 3) {
+      const uint32_t v = uint32_t(data[i]) << 16 |
+                         (i + 1 < n ? uint32_t(data[i + 1]) << 8 : 0) |
+                         (i + 2 < n ? uint32_t(data[i + 2]) : 0);
+      out.push_back(kChars[(v >> 18) & 63]);
+      out.push_back(kChars[(v >> 12) & 63]);
+      out.push_back(i + 1 < n ? kChars[(v >> 6) & 63] : '=');
+      out.push_back(i + 2 < n ? kChars[v & 63] : '=');
+    }
+    return out;
+  }
+
+  Transport transport_;
+  std::vector<char> buf_;  // data in [begin_, end_), then the padding
+  size_t begin_{0};
+  size_t end_{0};
+  size_t maxMessage_;
+  std::string message_;  // fragments of the message in progress
+  bool fragmented_{false};
+  bool skipping_{false};  // continuations of a message too long
+  uint64_t skip_{0};      // payload bytes of it still to drop
+  bool open_{false};
+  bool closeSent_{false};
+  uint64_t bytes_{0};
+  uint64_t messages_{0};
+  uint64_t skipped_{0};
+  std::mt19937_64 rng_{std::random_device{}()};
+};
+
+}  // namespace ngh::net
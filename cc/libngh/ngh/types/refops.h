@@ -0,0 +1,245 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "ngh/types/types.h"
+
+namespace ngh {
+
+// Array versions of the Ref transforms. The Ref overloads apply one Ref to
+// every element, the RefColumns overloads apply ref i to element i. Loops
+// are branch free over contiguous arrays so they auto-vectorize, with SSE2
+// for all but quote_px, whose floor needs SSE4.1 and -fno-trapping-math;
+// `in` and `out` must have the same size and must not overlap.
+//
+// A Ref per element is only contiguous as columns: a loop over Refs strides
+// over whole Refs and doesn't vectorize. The Refs overloads therefore build
+// the columns first; build RefColumns once to reuse them.
+
+struct RefColumns {
+  explicit RefColumns(const Refs& refs) {
+    price_ratio.reserve(refs.size());
+    px_offset.reserve(refs.size());
+    qty_scale.reserve(refs.size());
+    flip.reserve(refs.size());
+    for (const auto& r : refs) {
+      price_ratio.push_back(r.price_ratio);
+      px_offset.push_back(r.px_offset);
+      qty_scale.push_back(std::abs(r.hedge_ratio));
+      flip.push_back(!(r.hedge_ratio > 0));
+    }
+  }
+  size_t size() const { return price_ratio.size(); }
+
+  std::vector<double> price_ratio;
+  std::vector<double> px_offset;
+  std::vector<double> qty_scale;  // |hedge_ratio|
+  std::vector<uint8_t> flip;      // 1 where the ref flips sides
+};
+
+namespace detail {
+// Side is a bool enum; as bytes the flip is a xor
+inline const uint8_t* bytes(const Side* p) {
+  return reinterpret_cast<const uint8_t*>(p);
+}
+inline uint8_t* bytes(Side* p) { return reinterpret_cast<uint8_t*>(p); }
+}  // namespace detail
+
+inline void norm_px(const Ref& ref, std::span<const Ref::Px> in,
+                    std::span<double> out) {
+  assert(in.size() == out.size());
+  const Ref r = ref;
+  const auto* __restrict src = in.data();
+  auto* __restrict dst = out.data();
+  for (size_t i = 0; i < in.size(); ++i) {
+    dst[i] = r.norm_px(src[i]);
+  }
+}
+
+inline void norm_px(const RefColumns& refs, std::span<const Ref::Px> in,
+                    std::span<double> out) {
+  assert(in.size() == refs.size() && in.size() == out.size());
+  const auto* __restrict ratio = refs.price_ratio.data();
+  const auto* __restrict offset = refs.px_offset.data();
+  const auto* __restrict src = in.data();
+  auto* __restrict dst = out.data();
+  for (size_t i = 0; i < in.size(); ++i) {
+    dst[i] = (static_cast<double>(src[i]) - offset[i]) / ratio[i];
+  }
+}
+
+inline void norm_px(const Refs& refs, std::span<const Ref::Px> in,
+                    std::span<double> out) {
+  norm_px(RefColumns(refs), in, out);
+}
+
+template <typename T>
+void norm_qty(const Ref& ref, std::span<const T> in, std::span<double> out) {
+  assert(in.size() == out.size());
+  const Ref r = ref;
+  const auto* __restrict src = in.data();
+  auto* __restrict dst = out.data();
+  for (size_t i = 0; i < in.size(); ++i) {
+    dst[i] = r.norm_qty(src[i]);
+  }
+}
+
+template <typename T>
+void norm_qty(const RefColumns& refs, std::span<const T> in,
+              std::span<double> out) {
+  assert(in.size() == refs.size() && in.size() == out.size());
+  const auto* __restrict scale = refs.qty_scale.data();
+  const auto* __restrict src = in.data();
+  auto* __restrict dst = out.data();
+  for (size_t i = 0; i < in.size(); ++i) {
+    dst[i] = static_cast<double>(src[i]) / scale[i];
+  }
+}
+
+template <typename T>
+void norm_qty(const Refs& refs, std::span<const T> in, std::span<double> out) {
+  norm_qty(RefColumns(refs), in, out);
+}
+
+inline void denorm_px(const Ref& ref, std::span<const double> in,
+                      std::span<Ref::Px> out) {
+  assert(in.size() == out.size());
+  const Ref r = ref;
+  const auto* __restrict src = in.data();
+  auto* __restrict dst = out.data();
+  for (size_t i = 0; i < in.size(); ++i) {
+    dst[i] = r.denorm_px(src[i]);
+  }
+}
+
+inline void denorm_px(const RefColumns& refs, std::span<const double> in,
+                      std::span<Ref::Px> out) {
+  assert(in.size() == refs.size() && in.size() == out.size());
+  const auto* __restrict ratio = refs.price_ratio.data();
+  const auto* __restrict offset = refs.px_offset.data();
+  const auto* __restrict src = in.data();
+  auto* __restrict dst = out.data();
+  for (size_t i = 0; i < in.size(); ++i) {
+    dst[i] = static_cast<Ref::Px>(src[i] * ratio[i] + offset[i]);
+  }
+}
+
+inline void denorm_px(const Refs& refs, std::span<const double> in,
+                      std::span<Ref::Px> out) {
+  denorm_px(RefColumns(refs), in, out);
+}
+
+inline void denorm_qty(const Ref& ref, std::span<const double> in,
+                       std::span<Ref::Qty> out) {
+  assert(in.size() == out.size());
+  const Ref r = ref;
+  const auto* __restrict src = in.data();
+  auto* __restrict dst = out.data();
+  for (size_t i = 0; i < in.size(); ++i) {
+    dst[i] = r.denorm_qty(src[i]);
+  }
+}
+
+inline void denorm_qty(const RefColumns& refs, std::span<const double> in,
+                       std::span<Ref::Qty> out) {
+  assert(in.size() == refs.size() && in.size() == out.size());
+  const auto* __restrict scale = refs.qty_scale.data();
+  const auto* __restrict src = in.data();
+  auto* __restrict dst = out.data();
+  for (size_t i = 0; i < in.size(); ++i) {
+    dst[i] = static_cast<Ref::Qty>(src[i] * scale[i]);
+  }
+}
+
+inline void denorm_qty(const Refs& refs, std::span<const double> in,
+                       std::span<Ref::Qty> out) {
+  denorm_qty(RefColumns(refs), in, out);
+}
+
+// norm_side and denorm_side are the same flip
+inline void flip_side(const Ref& ref, std::span<const Side> in,
+                      std::span<Side> out) {
+  assert(in.size() == out.size());
+  const uint8_t flip = !(ref.hedge_ratio > 0);
+  const auto* __restrict src = detail::bytes(in.data());
+  auto* __restrict dst = detail::bytes(out.data());
+  for (size_t i = 0; i < in.size(); ++i) {
+    dst[i] = src[i] ^ flip;
+  }
+}
+
+inline void flip_side(const RefColumns& refs, std::span<const Side> in,
+                      std::span<Side> out) {
+  assert(in.size() == refs.size() && in.size() == out.size());
+  const auto* __restrict flip = refs.flip.data();
+  const auto* __restrict src = detail::bytes(in.data());
+  auto* __restrict dst = detail::bytes(out.data());
+  for (size_t i = 0; i < in.size(); ++i) {
+    dst[i] = src[i] ^ flip[i];
+  }
+}
+
+inline void flip_side(const Refs& refs, std::span<const Side> in,
+                      std::span<Side> out) {
+  flip_side(RefColumns(refs), in, out);
+}
+
+// Quote generation: denormalizes quotes given in normalized space and rounds
+// them to the exchange tick away from the touch, i.e. bids down and asks up
+// on the exchange side (after the hedge ratio side flip).
+inline Ref::Px quote_px(const Ref& ref, const Side side, const double px) {
+  const double sign = IsBid(ref.denorm_side(side)) ? 1. : -1.;
+  return static_cast<Ref::Px>(
+      sign * std::floor(sign * (px * ref.price_ratio + ref.px_offset)));
+}
+
+// The above on side bytes, with `flip` the ref's side flip: the sign is -1
+// for exchange asks, i.e. where the side bit and the flip differ.
+namespace detail {
+inline Ref::Px quotePx(const uint8_t side, const uint8_t flip,
+                       const double ratio, const double offset,
+                       const double px) {
+  const double sign = 1. - 2. * static_cast<double>(side ^ flip);
+  return static_cast<Ref::Px>(sign *
+                              std::floor(sign * (px * ratio + offset)));
+}
+}  // namespace detail
+
+inline void quote_px(const Ref& ref, std::span<const Side> side,
+                     std::span<const double> in, std::span<Ref::Px> out) {
+  assert(in.size() == side.size() && in.size() == out.size());
+  const uint8_t flip = !(ref.hedge_ratio > 0);
+  const double ratio = ref.price_ratio;
+  const double offset = ref.px_offset;
+  const auto* __restrict sides = detail::bytes(side.data());
+  const auto* __restrict src = in.data();
+  auto* __restrict dst = out.data();
+  for (size_t i = 0; i < in.size(); ++i) {
+    dst[i] = detail::quotePx(sides[i], flip, ratio, offset, src[i]);
+  }
+}
+
+inline void quote_px(const RefColumns& refs, std::span<const Side> side,
+                     std::span<const double> in, std::span<Ref::Px> out) {
+  assert(in.size() == refs.size() && in.size() == side.size() &&
+         in.size() == out.size());
+  const auto* __restrict flip = refs.flip.data();
+  const auto* __restrict ratio = refs.price_ratio.data();
+  const auto* __restrict offset = refs.px_offset.data();
+  const auto* __restrict sides = detail::bytes(side.data());
+  const auto* __restrict src = in.data();
+  auto* __restrict dst = out.data();
+  for (size_t i = 0; i < in.size(); ++i) {
+    dst[i] = detail::quotePx(sides[i], flip[i], ratio[i], offset[i], src[i]);
+  }
+}
+
+inline void quote_px(const Refs& refs, std::span<const Side> side,
+                     std::span<const double> in, std::span<Ref::Px> out) {
+  quote_px(RefColumns(refs), side, in, out);
+}
+
+}  // namespace ngh
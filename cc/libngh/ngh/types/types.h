@@ -1,4 +1,9 @@
 #pragma once
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+
 #include "ngh/types/time.h"
 
 namespace ngh {
@@ -25,6 +30,7 @@ constexpr bool IsAsk(Side v) { return v == Side::kAsk; }
 constexpr Side operator~(Side v) { return IsBuy(v) ? Side::kSell : Side::kBuy; }
 
 using OID = int64_t;
+using MarketId = uint32_t;
 using Qty = double;
 using Px = double;
 struct Order {
@@ -40,7 +46,41 @@ struct Order {
   bool postOnly;
   bool ioc;
 };
-using Balances = std::map<std::string, Qty>;
+
+enum class OrderType : uint8_t { kLimit = 0, kMarket = 1, kOther = 2 };
+
+// Flat copy of an Order with enums in place of strings, for bulk export
+struct OrderRow {
+  enum Flags : uint8_t { kReduceOnly = 1, kPostOnly = 2, kIoc = 4 };
+
+  OID id;
+  Px price;
+  Qty size;
+  Qty filledSize;
+  Qty remainingSize;
+  MarketId market;
+  uint8_t side;  // Side
+  uint8_t type;  // OrderType
+  uint8_t flags;
+};
+inline OrderRow toRow(const Order& o, const MarketId market) {
+  const auto type = o.type == "limit"    ? OrderType::kLimit
+                    : o.type == "market" ? OrderType::kMarket
+                                         : OrderType::kOther;
+  return {o.id,
+          o.price,
+          o.size,
+          o.filledSize,
+          o.remainingSize,
+          market,
+          uint8_t(o.side == "sell" ? Side::kSell : Side::kBuy),
+          uint8_t(type),
+          uint8_t((o.reduceOnly ? OrderRow::kReduceOnly : 0) |
+                  (o.postOnly ? OrderRow::kPostOnly : 0) |
+                  (o.ioc ? OrderRow::kIoc : 0))};
+}
+
+using Balances = std::map<std::string, Qty, std::less<>>;
 using PriceBook = std::map<Px, Qty>;
 using OrderBook = std::map<OID, Order>;
 
@@ -61,7 +101,7 @@ struct Ref {
   }
   template <typename T>
   double norm_qty(const T qty) const {
-    return static_cast<double>(qty) / abs(hedge_ratio);
+    return static_cast<double>(qty) / std::abs(hedge_ratio);
   }
   Side norm_side(const Side side) const {
     return hedge_ratio > 0 ? side : ~side;
@@ -70,7 +110,7 @@ struct Ref {
     return static_cast<Px>(px * price_ratio + px_offset);
   }
   Qty denorm_qty(const double qty) const {
-    return static_cast<Qty>(qty * abs(hedge_ratio));
+    return static_cast<Qty>(qty * std::abs(hedge_ratio));
   }
   Side denorm_side(const Side side) const {
     return hedge_ratio > 0 ? side : ~side;
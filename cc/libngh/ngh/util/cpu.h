@@ -0,0 +1,82 @@
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace ngh::util {
+
+// Restricts `thread` to `cpu`.
+inline void pinThread(const pthread_t thread, const int cpu) {
+  if (cpu < 0 || cpu >= CPU_SETSIZE) {
+    throw std::invalid_argument("bad cpu " + std::to_string(cpu));
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (const int rc = ::pthread_setaffinity_np(thread, sizeof(set), &set)) {
+    throw std::runtime_error("failed to pin thread to cpu " +
+                             std::to_string(cpu) + ": " + std::strerror(rc));
+  }
+}
+
+// Throws unless `cpu` exists and this process may run on it, so a pinning
+// mistake shows up before a thread is started for it.
+inline void checkCpu(const int cpu) {
+  if (cpu < 0 || cpu >= CPU_SETSIZE) {
+    throw std::invalid_argument("bad cpu " + std::to_string(cpu));
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (::sched_getaffinity(0, sizeof(set), &set) != 0) {
+    throw std::runtime_error(std::string("sched_getaffinity failed: ") +
+                             std::strerror(errno));
+  }
+  if (!CPU_ISSET(cpu, &set)) {
+    throw std::invalid_argument("cpu " + std::to_string(cpu) +
+                                " is not available to this process");
+  }
+}
+
+// Parses a kernel cpu list such as "2-5,8".
+inline std::vector<int> parseCpuList(const std::string& list) {
+  std::vector<int> cpus;
+  std::stringstream in(list);
+  std::string range;
+  while (std::getline(in, range, ',')) {
+    if (range.find_first_not_of(" \n") == std::string::npos) {
+      continue;
+    }
+    const auto dash = range.find('-');
+    const int first = std::stoi(range.substr(0, dash));
+    const int last =
+        dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+// Cpus taken out of the scheduler with isolcpus=, empty if none or unknown.
+inline std::vector<int> isolatedCpus() {
+  std::ifstream in("/sys/devices/system/cpu/isolated");
+  std::string list;
+  std::getline(in, list);
+  return parseCpuList(list);
+}
+
+inline bool isIsolated(const int cpu) {
+  const auto cpus = isolatedCpus();
+  return std::find(cpus.begin(), cpus.end(), cpu) != cpus.end();
+}
+
+}  // namespace ngh::util
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+namespace ngh::util {
+
+constexpr size_t kCacheLine = 64;
+
+// Bounded lock-free single producer / single consumer queue. Each side keeps
+// a cached copy of the other side's index so the shared cache lines are only
+// touched when the cached view says the queue is full / empty.
+template <typename T>
+class SpscQueue {
+ public:
+  explicit SpscQueue(const size_t capacity)
+      : slots_(std::bit_ceil(std::max<size_t>(capacity, 2))),
+        mask_(slots_.size() - 1) {}
+
+  // producer
+  bool push(T&& v) {
+    const auto tail = tail_.load(std::memory_order_relaxed);
+    if (tail - headCache_ == slots_.size()) {
+      headCache_ = head_.load(std::memory_order_acquire);
+      if (tail - headCache_ == slots_.size()) {
+        return false;
+      }
+    }
+    slots_[tail & mask_] = std::move(v);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer
+  bool pop(T& v) {
+    const auto head = head_.load(std::memory_order_relaxed);
+    if (head == tailCache_) {
+      tailCache_ = tail_.load(std::memory_order_acquire);
+      if (head == tailCache_) {
+        return false;
+      }
+    }
+    v = std::move(slots_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  size_t capacity() const { return slots_.size(); }
+
+ private:
+  std::vector<T> slots_;
+  size_t mask_;
+  alignas(kCacheLine) std::atomic<size_t> head_{0};
+  size_t tailCache_{0};  // consumer's view of tail_
+  alignas(kCacheLine) std::atomic<size_t> tail_{0};
+  size_t headCache_{0};  // producer's view of head_
+};
+
+struct SpscRingStats {
+  // producer
+  size_t pushed{0};
+  size_t rejected{0};  // reserve() calls that found the ring full
+  size_t bytes{0};     // payload bytes pushed
+  size_t peak{0};      // most bytes in use seen by the producer
+  // consumer
+  size_t popped{0};
+  size_t batches{0};  // drain() calls that found messages
+};
+
+// Bounded lock-free single producer / single consumer ring of variable length
+// messages, stored inline: no allocation per message, and each message is
+// followed by `padding` readable bytes so it can be parsed in place (pass
+// SIMDJSON_PADDING). Records start on a cache line, so the producer filling
+// one never shares a line with the consumer reading the previous one.
+//
+// The producer may write straight into the ring with reserve() / commit(),
+// e.g. recv() into it. The consumer takes whatever is there in one drain(),
+// which costs one acquire and one release per batch rather than per message.
+class SpscByteRing {
+ public:
+  SpscByteRing(const size_t capacity, const size_t padding)
+      : capacity_(std::bit_ceil(
+            std::max(capacity, 4 * (kHeader + padding + kCacheLine)))),
+        mask_(capacity_ - 1),
+        padding_(padding),
+        data_(static_cast<char*>(std::aligned_alloc(kCacheLine, capacity_))) {
+    if (!data_) {
+      throw std::bad_alloc();
+    }
+  }
+
+  // Largest message that fits; larger ones are rejected with an exception
+  // since they never would.
+  size_t maxMessage() const {
+    return capacity_ / 2 - kHeader - padding_;
+  }
+
+  // producer: room for `size` bytes plus padding, nullptr if the ring is full
+  char* reserve(const size_t size) {
+    const auto need = stride(size);
+    if (need > capacity_ / 2) {
+      throw std::invalid_argument("message larger than half the ring");
+    }
+    const auto tail = tail_.load(std::memory_order_relaxed);
+    const auto offset = tail & mask_;
+    // records don't wrap; the rest of the line is skipped instead
+    start_ = offset + need > capacity_ ? tail + capacity_ - offset : tail;
+    if (start_ + need - headCache_ > capacity_) {
+      headCache_ = head_.load(std::memory_order_acquire);
+      if (start_ + need - headCache_ > capacity_) {
+        bump(rejected_);
+        return nullptr;
+      }
+    }
+    const auto used = start_ + need - headCache_;
+    if (used > peak_.load(std::memory_order_relaxed)) {
+      peak_.store(used, std::memory_order_relaxed);
+    }
+    return data_.get() + (start_ & mask_) + kHeader;
+  }
+
+  // producer: publishes the last reserve(), `size` may be smaller than asked
+  void commit(const size_t size) {
+    const auto tail = tail_.load(std::memory_order_relaxed);
+    if (start_ != tail) {
+      header(tail) = kSkip;
+    }
+    header(start_) = size;
+    bump(pushed_);
+    bump(bytes_, size);
+    tail_.store(start_ + stride(size), std::memory_order_release);
+  }
+
+  // producer: false if the ring is full
+  bool push(const std::string_view msg) {
+    auto* p = reserve(msg.size());
+    if (!p) {
+      return false;
+    }
+    std::memcpy(p, msg.data(), msg.size());
+    commit(msg.size());
+    return true;
+  }
+
+  // consumer: calls f(std::string_view) for up to `maxMessages` messages,
+  // which stay valid until drain() returns; returns how many.
+  template <typename F>
+  size_t drain(F&& f, const size_t maxMessages = SIZE_MAX) {
+    auto head = head_.load(std::memory_order_relaxed);
+    const auto tail = tail_.load(std::memory_order_acquire);
+    size_t n = 0;
+    while (head != tail && n < maxMessages) {
+      const auto size = header(head);
+      if (size == kSkip) {
+        head += capacity_ - (head & mask_);
+        continue;
+      }
+      f(std::string_view(data_.get() + (head & mask_) + kHeader, size));
+      head += stride(size);
+      ++n;
+    }
+    if (n) {
+      bump(popped_, n);
+      bump(batches_);
+    }
+    head_.store(head, std::memory_order_release);
+    return n;
+  }
+
+  bool empty() const {
+    return head_.load(std::memory_order_acquire) ==
+           tail_.load(std::memory_order_acquire);
+  }
+  size_t capacity() const { return capacity_; }
+
+  // Counters are updated with relaxed stores, any thread may read them.
+  SpscRingStats stats() const {
+    constexpr auto kRelaxed = std::memory_order_relaxed;
+    return {pushed_.load(kRelaxed), rejected_.load(kRelaxed),
+            bytes_.load(kRelaxed),  peak_.load(kRelaxed),
+            popped_.load(kRelaxed), batches_.load(kRelaxed)};
+  }
+
+ private:
+  static constexpr size_t kHeader = sizeof(uint64_t);
+  static constexpr uint64_t kSkip = UINT64_MAX;
+
+  struct Free {
+    void operator()(char* p) const { std::free(p); }
+  };
+
+  // only written by the owning side
+  static void bump(std::atomic<size_t>& counter, const size_t n = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + n,
+                  std::memory_order_relaxed);
+  }
+
+  size_t stride(const size_t size) const {
+    return (kHeader + size + padding_ + kCacheLine - 1) & ~(kCacheLine - 1);
+  }
+  uint64_t& header(const size_t pos) const {
+    return *reinterpret_cast<uint64_t*>(data_.get() + (pos & mask_));
+  }
+
+  const size_t capacity_;
+  const size_t mask_;
+  const size_t padding_;
+  std::unique_ptr<char, Free> data_;
+  alignas(kCacheLine) std::atomic<size_t> head_{0};
+  std::atomic<size_t> popped_{0};
+  std::atomic<size_t> batches_{0};
+  alignas(kCacheLine) std::atomic<size_t> tail_{0};
+  size_t headCache_{0};  // producer's view of head_
+  size_t start_{0};      // of the reserved record
+  std::atomic<size_t> pushed_{0};
+  std::atomic<size_t> rejected_{0};
+  std::atomic<size_t> bytes_{0};
+  std::atomic<size_t> peak_{0};
+};
+
+}  // namespace ngh::util
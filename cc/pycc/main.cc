@@ -1,8 +1,24 @@
+#include <pybind11/numpy.h>
 #include <pybind11/stl.h>
 #include <pybind11/stl_bind.h>
 
+#include "ngh/io/capturereader.h"
+#include "ngh/io/eventlog.h"
+#include "ngh/io/mergereader.h"
+#include "ngh/io/tickstore.h"
+#include "ngh/io/uringreader.h"
+#include "ngh/mkt/batch.h"
+#include "ngh/mkt/ftxeventlog.h"
 #include "ngh/mkt/ftxhandler.h"
+#include "ngh/mkt/ftxstate.h"
+#include "ngh/mkt/ftxtickstore.h"
+#include "ngh/mkt/parallel.h"
+#include "ngh/mkt/replay.h"
+#include "ngh/mkt/shardedfeed.h"
+#include "ngh/mkt/shards.h"
+#include "ngh/types/refops.h"
 #include "ngh/types/types.h"
+#include "ngh/util/spsc.h"
 #include "pybind11/pybind11.h"
 
 PYBIND11_MAKE_OPAQUE(ngh::Refs);
@@ -12,6 +28,151 @@ PYBIND11_MAKE_OPAQUE(ngh::OrderBook);
 
 namespace pycc {
 
+template <typename T>
+using CArray = pybind11::array_t<T, pybind11::array::c_style>;
+template <typename T>
+using CArrayCast =
+    pybind11::array_t<T, pybind11::array::c_style | pybind11::array::forcecast>;
+
+// out must be [len(grid), len(markets), depth, BookSampler::kNumFields]
+void checkSamplerOutput(const CArray<float>& out, const size_t rows,
+                        const size_t markets, const size_t depth) {
+  if (out.ndim() != 4 || size_t(out.shape(0)) != rows ||
+      size_t(out.shape(1)) != markets || size_t(out.shape(2)) != depth ||
+      size_t(out.shape(3)) != ngh::mkt::BookSampler::kNumFields) {
+    throw std::invalid_argument(
+        "sampler output must be float32 [time, market, level, field]");
+  }
+}
+
+template <typename T>
+CArray<T> emptyLike(const pybind11::array& a) {
+  return CArray<T>(std::vector<ssize_t>(a.shape(), a.shape() + a.ndim()));
+}
+
+template <typename T>
+std::span<T> asSpan(CArray<T>& a, const size_t offset = 0,
+                    const size_t count = -1) {
+  return {a.mutable_data() + offset, std::min<size_t>(count, a.size())};
+}
+template <typename T>
+std::span<const T> asSpan(const CArrayCast<T>& a, const size_t offset = 0,
+                          const size_t count = -1) {
+  return {a.data() + offset, std::min<size_t>(count, a.size())};
+}
+
+// Runs `f(ref, offset, count)` once over a 1d array with one element per ref,
+// or once per row of a [len(refs), ...] array.
+template <typename F>
+void forEachRef(const ngh::Refs& refs, const pybind11::array& a, F f) {
+  if (a.ndim() == 0 || size_t(a.shape(0)) != refs.size()) {
+    throw std::invalid_argument("array must have one row per ref");
+  }
+  if (a.ndim() == 1) {
+    f(refs, 0, a.size());
+    return;
+  }
+  const size_t width = refs.empty() ? 0 : a.size() / refs.size();
+  for (size_t i = 0; i < refs.size(); ++i) {
+    f(refs[i], i * width, width);
+  }
+}
+
+// Binds `kernel(ref, in, out)` elementwise for a single Ref or for Refs.
+template <typename In, typename Out, typename F>
+void defRefKernel(pybind11::module_& m, const char* name, F kernel) {
+  m.def(name, [kernel](const ngh::Ref& ref, const CArrayCast<In>& in) {
+    auto out = emptyLike<Out>(in);
+    kernel(ref, asSpan(in), asSpan(out));
+    return out;
+  });
+  m.def(name, [kernel](const ngh::Refs& refs, const CArrayCast<In>& in) {
+    auto out = emptyLike<Out>(in);
+    forEachRef(refs, in, [&](const auto& r, size_t offset, size_t count) {
+      kernel(r, asSpan(in, offset, count), asSpan(out, offset, count));
+    });
+    return out;
+  });
+}
+
+// Binds FtxHandler member `f` so that it throws while an ingest or feed
+// thread, or a call without the GIL, applies to the handler instead of
+// racing it, see checkIdle().
+template <typename R, typename... Args>
+auto idle(R (ngh::mkt::FtxHandler::*f)(Args...)) {
+  return [f](ngh::mkt::FtxHandler& self, Args... args) -> R {
+    self.checkIdle();
+    return (self.*f)(std::forward<Args>(args)...);
+  };
+}
+template <typename R, typename... Args>
+auto idle(R (ngh::mkt::FtxHandler::*f)(Args...) const) {
+  return [f](const ngh::mkt::FtxHandler& self, Args... args) -> R {
+    self.checkIdle();
+    return (self.*f)(std::forward<Args>(args)...);
+  };
+}
+
+// Runs `f()`, which applies messages to `self`, with the GIL released, then
+// hands out the events still batched. The handler is marked busy until the
+// GIL is back, so other Python threads can't use it meanwhile.
+template <typename F>
+auto applyWithoutGil(ngh::mkt::FtxHandler& self, F&& f) {
+  const ngh::mkt::FtxHandler::Applying applying(self);
+  pybind11::gil_scoped_release release;
+  auto result = f();
+  if (auto* events = self.getEventBatcher()) {
+    events->flush();
+  }
+  return result;
+}
+
+using FileReplayer = ngh::mkt::Replayer<ngh::io::CaptureReader>;
+using Ingest = ngh::mkt::IngestThread<ngh::mkt::FtxHandler>;
+using Feed = ngh::mkt::FeedThread<ngh::mkt::FtxHandler>;
+
+ngh::mkt::FeedConfig feedConfig(const double ping_s, const bool busy_poll,
+                                const int cpu, const int busy_poll_us) {
+  ngh::mkt::FeedConfig config;
+  config.pingInterval = std::chrono::duration_cast<ngh::Duration>(
+      std::chrono::duration<double>(ping_s));
+  config.busyPoll = busy_poll;
+  config.cpu = cpu;
+  config.busyPollUs = busy_poll_us;
+  return config;
+}
+
+// The read side shared by Ingest and Feed.
+template <typename Class>
+void defTopPublisher(Class& cls) {
+  using T = typename Class::type;
+  cls.def("fileno", &T::fd)
+      .def("ack", &T::ack)
+      .def("getTop",
+           [](const T& self, const ngh::MarketId market) -> pybind11::object {
+             ngh::mkt::TopOfBook top;
+             if (!self.getTop(market, top)) {
+               return pybind11::none();
+             }
+             return pybind11::make_tuple(top.bidPx, top.bidSz, top.askPx,
+                                         top.askSz, top.lastTs);
+           })
+      .def("getMarkets", [](const T& self) {
+        std::vector<std::string> markets(self.numMarkets());
+        for (ngh::MarketId m = 0; m < markets.size(); ++m) {
+          markets[m] = self.getMarket(m);
+        }
+        return markets;
+      });
+}
+
+std::span<const ngh::Side> asSides(std::span<const bool> s) {
+  return {reinterpret_cast<const ngh::Side*>(s.data()), s.size()};
+}
+std::span<ngh::Side> asSides(std::span<bool> s) {
+  return {reinterpret_cast<ngh::Side*>(s.data()), s.size()};
+}
+
 PYBIND11_MODULE(pycc, m) {
   auto m_ngh = m.def_submodule("ngh");
   pybind11::class_<ngh::Order>(m_ngh, "Order")
@@ -32,6 +193,14 @@ PYBIND11_MODULE(pycc, m) {
                                      pybind11::module_local(true));
   pybind11::bind_map<ngh::Balances>(m_ngh, "Balances",
                                     pybind11::module_local(true));
+  pybind11::enum_<ngh::OrderType>(m_ngh, "OrderType")
+      .value("kLimit", ngh::OrderType::kLimit)
+      .value("kMarket", ngh::OrderType::kMarket)
+      .value("kOther", ngh::OrderType::kOther);
+  PYBIND11_NUMPY_DTYPE_EX(ngh::OrderRow, id, "id", market, "market_id", side,
+                          "side", type, "type", price, "price", size, "size",
+                          filledSize, "filled", remainingSize, "remaining",
+                          flags, "flags");
   pybind11::class_<ngh::Ref>(m_ngh, "Ref")
       .def(pybind11::init<>())
       .def_readwrite("price_exp", &ngh::Ref::price_exp)
@@ -42,7 +211,73 @@ PYBIND11_MODULE(pycc, m) {
       .def_readwrite("mark_px", &ngh::Ref::mark_px);
   pybind11::bind_vector<ngh::Refs>(m_ngh, "Refs", pybind11::module_local(true));
 
+  // vectorized Ref transforms over numpy arrays
+  defRefKernel<ngh::Ref::Px, double>(
+      m_ngh, "norm_px",
+      [](const auto& r, auto in, auto out) { ngh::norm_px(r, in, out); });
+  defRefKernel<double, double>(
+      m_ngh, "norm_qty",
+      [](const auto& r, auto in, auto out) { ngh::norm_qty(r, in, out); });
+  defRefKernel<double, ngh::Ref::Px>(
+      m_ngh, "denorm_px",
+      [](const auto& r, auto in, auto out) { ngh::denorm_px(r, in, out); });
+  defRefKernel<double, ngh::Ref::Qty>(
+      m_ngh, "denorm_qty",
+      [](const auto& r, auto in, auto out) { ngh::denorm_qty(r, in, out); });
+  const auto flipSide = [](const auto& r, auto in, auto out) {
+    ngh::flip_side(r, asSides(in), asSides(out));
+  };
+  defRefKernel<bool, bool>(m_ngh, "norm_side", flipSide);
+  defRefKernel<bool, bool>(m_ngh, "denorm_side", flipSide);
+  m_ngh.def(
+      "quote_px",
+      [](const ngh::Ref& ref, const CArrayCast<bool>& side,
+         const CArrayCast<double>& px) {
+        if (side.size() != px.size()) {
+          throw std::invalid_argument("side and px must have the same size");
+        }
+        auto out = emptyLike<ngh::Ref::Px>(px);
+        ngh::quote_px(ref, asSides(asSpan(side)), asSpan(px), asSpan(out));
+        return out;
+      },
+      pybind11::arg("ref"), pybind11::arg("side"), pybind11::arg("px"));
+  m_ngh.def(
+      "quote_px",
+      [](const ngh::Refs& refs, const CArrayCast<bool>& side,
+         const CArrayCast<double>& px) {
+        if (side.size() != px.size()) {
+          throw std::invalid_argument("side and px must have the same size");
+        }
+        auto out = emptyLike<ngh::Ref::Px>(px);
+        forEachRef(refs, px, [&](const auto& r, size_t offset, size_t count) {
+          ngh::quote_px(r, asSides(asSpan(side, offset, count)),
+                        asSpan(px, offset, count), asSpan(out, offset, count));
+        });
+        return out;
+      },
+      pybind11::arg("refs"), pybind11::arg("side"), pybind11::arg("px"));
+
+  auto m_io = m_ngh.def_submodule("io");
+  pybind11::class_<ngh::io::ReadStats>(m_io, "ReadStats")
+      .def_readonly("bytes", &ngh::io::ReadStats::bytes)
+      .def_readonly("blocks", &ngh::io::ReadStats::blocks)
+      .def_readonly("stalls", &ngh::io::ReadStats::stalls)
+      .def_readonly("stall_seconds", &ngh::io::ReadStats::stallSeconds)
+      .def_readonly("uring", &ngh::io::ReadStats::uring);
+
   auto m_mkt = m_ngh.def_submodule("mkt");
+  PYBIND11_NUMPY_DTYPE(ngh::mkt::Event, ts, id, px, qty, market, type, side,
+                       flags);
+  PYBIND11_NUMPY_DTYPE_EX(ngh::mkt::TopOfBook, market, "market_id", bidPx,
+                          "bid_px", bidSz, "bid_sz", askPx, "ask_px", askSz,
+                          "ask_sz", lastTs, "last_ts");
+  PYBIND11_NUMPY_DTYPE_EX(ngh::mkt::BatchStats, lines, "lines", markets,
+                          "markets", lastTs, "last_ts", seconds, "seconds");
+  pybind11::enum_<ngh::mkt::EventType>(m_mkt, "EventType")
+      .value("kBook", ngh::mkt::EventType::kBook)
+      .value("kTrade", ngh::mkt::EventType::kTrade)
+      .value("kFill", ngh::mkt::EventType::kFill)
+      .value("kOrder", ngh::mkt::EventType::kOrder);
   pybind11::class_<ngh::mkt::L2StateTracker>(m_mkt, "L2StateTracker")
       .def_readonly("lastTs", &ngh::mkt::L2StateTracker::lastTs)
       .def("getBids", &ngh::mkt::L2StateTracker::getBids,
@@ -54,15 +289,516 @@ PYBIND11_MODULE(pycc, m) {
       .def_readonly("lastTradeQty", &ngh::mkt::L2StateTracker::lastTradeQty)
       .def_readonly("lastTradeIsLiquidation",
                     &ngh::mkt::L2StateTracker::lastTradeIsLiquidation)
-      .def_readwrite("orders", &ngh::mkt::L2StateTracker::orders);
+      .def_readwrite("orders", &ngh::mkt::L2StateTracker::orders)
+      .def(
+          "exportOrders",
+          [](const ngh::mkt::L2StateTracker& self, const ngh::MarketId market) {
+            CArray<ngh::OrderRow> out(self.orders.size());
+            self.exportOrders(market, asSpan(out));
+            return out;
+          },
+          pybind11::arg("market_id") = 0);
+
+  pybind11::class_<ngh::util::SpscRingStats>(m_mkt, "RingStats")
+      .def_readonly("pushed", &ngh::util::SpscRingStats::pushed)
+      .def_readonly("rejected", &ngh::util::SpscRingStats::rejected)
+      .def_readonly("bytes", &ngh::util::SpscRingStats::bytes)
+      .def_readonly("peak", &ngh::util::SpscRingStats::peak)
+      .def_readonly("popped", &ngh::util::SpscRingStats::popped)
+      .def_readonly("batches", &ngh::util::SpscRingStats::batches);
+
+  // asyncio: loop.add_reader(ingest.fileno(), ...) then ack() before reading
+  // shared with the FtxHandler, so it outlives stopIngest() and reset()
+  pybind11::class_<Ingest, std::shared_ptr<Ingest>> ingest(m_mkt, "Ingest");
+  defTopPublisher(ingest);
+  ingest.def("push", &Ingest::push)
+      .def_property_readonly("running", &Ingest::running)
+      .def_property_readonly("error", &Ingest::error)
+      .def_property_readonly("applied", &Ingest::applied)
+      .def_property_readonly("dropped", &Ingest::dropped)
+      .def_property_readonly("stats", &Ingest::stats);
+
+  pybind11::class_<ngh::mkt::FeedStats>(m_mkt, "FeedStats")
+      .def_readonly("polls", &ngh::mkt::FeedStats::polls)
+      .def_readonly("empty_polls", &ngh::mkt::FeedStats::emptyPolls)
+      .def_readonly("busy_seconds", &ngh::mkt::FeedStats::busySeconds)
+      .def_readonly("idle_seconds", &ngh::mkt::FeedStats::idleSeconds)
+      .def_readonly("isolated", &ngh::mkt::FeedStats::isolated);
+
+  // like Ingest
+  pybind11::class_<Feed, std::shared_ptr<Feed>> feed(m_mkt, "Feed");
+  defTopPublisher(feed);
+  feed.def("stop", &Feed::stop,
+           pybind11::call_guard<pybind11::gil_scoped_release>())
+      .def_property_readonly("running", &Feed::running)
+      .def_property_readonly("error", &Feed::error)
+      .def_property_readonly("received", &Feed::received)
+      .def_property_readonly("applied", &Feed::applied)
+      .def_property_readonly("skipped", &Feed::skipped)
+      .def_property_readonly("busy_poll",
+                             [](const Feed& self) {
+                               return self.config().busyPoll;
+                             })
+      .def_property_readonly(
+          "cpu", [](const Feed& self) { return self.config().cpu; })
+      .def_property_readonly("stats", &Feed::stats);
+
+  // one Feed per shard; getTop() takes market names
+  pybind11::class_<ngh::mkt::ShardedFeed>(m_mkt, "ShardedFeed")
+      .def(pybind11::init([](const std::string& host, const uint16_t port,
+                             const std::vector<std::string>& subscribe,
+                             const std::string& path, const size_t shards,
+                             const size_t max_markets, const double ping_s,
+                             const bool busy_poll, const int cpu,
+                             const int busy_poll_us) {
+             const auto config =
+                 feedConfig(ping_s, busy_poll, cpu, busy_poll_us);
+             pybind11::gil_scoped_release release;
+             return std::make_unique<ngh::mkt::ShardedFeed>(
+                 host, port, path, subscribe, shards, max_markets, config);
+           }),
+           pybind11::arg("host"), pybind11::arg("port"),
+           pybind11::arg("subscribe"), pybind11::arg("path") = "/ws",
+           pybind11::arg("shards") = 4, pybind11::arg("max_markets") = 4096,
+           pybind11::arg("ping_s") = 15.0, pybind11::arg("busy_poll") = false,
+           pybind11::arg("cpu") = -1, pybind11::arg("busy_poll_us") = 0)
+      .def("fileno", &ngh::mkt::ShardedFeed::fd)
+      .def("ack", &ngh::mkt::ShardedFeed::ack)
+      .def("getTop",
+           [](ngh::mkt::ShardedFeed& self,
+              const std::string_view market) -> pybind11::object {
+             ngh::mkt::TopOfBook top;
+             if (!self.getTop(market, top)) {
+               return pybind11::none();
+             }
+             return pybind11::make_tuple(top.bidPx, top.bidSz, top.askPx,
+                                         top.askSz, top.lastTs);
+           })
+      .def("getMarkets", &ngh::mkt::ShardedFeed::getMarkets)
+      .def("shardOf", &ngh::mkt::ShardedFeed::shardOf)
+      .def("shard", &ngh::mkt::ShardedFeed::shard,
+           pybind11::return_value_policy::reference_internal)
+      .def("handler", &ngh::mkt::ShardedFeed::handler,
+           pybind11::return_value_policy::reference_internal)
+      .def("getBook", &ngh::mkt::ShardedFeed::getBook,
+           pybind11::return_value_policy::reference_internal)
+      .def("stop", &ngh::mkt::ShardedFeed::stop,
+           pybind11::call_guard<pybind11::gil_scoped_release>())
+      .def_property_readonly("running", &ngh::mkt::ShardedFeed::running)
+      .def_property_readonly("num_shards", &ngh::mkt::ShardedFeed::numShards)
+      .def_property_readonly("account_shard",
+                             &ngh::mkt::ShardedFeed::accountShard);
+
+  // shared with the FtxHandler, so it outlives disableArbitration()
+  pybind11::class_<ngh::mkt::FeedArbiter,
+                   std::shared_ptr<ngh::mkt::FeedArbiter>>(m_mkt,
+                                                           "FeedArbiter")
+      .def(pybind11::init([](const int64_t window_us) {
+             return std::make_shared<ngh::mkt::FeedArbiter>(
+                 std::chrono::microseconds(window_us));
+           }),
+           pybind11::arg("window_us") = 5000000)
+      .def("accept",
+           [](ngh::mkt::FeedArbiter& self, const std::string_view msg) {
+             return self.accept(msg);
+           })
+      .def_property_readonly("forwarded", &ngh::mkt::FeedArbiter::forwarded)
+      .def_property_readonly("dropped", &ngh::mkt::FeedArbiter::dropped);
 
   pybind11::class_<ngh::mkt::FtxHandler>(m_mkt, "FtxHandler")
       .def(pybind11::init<>())
       .def("reset", &ngh::mkt::FtxHandler::reset)
-      .def("onMessage", &ngh::mkt::FtxHandler::onMessage)
-      .def("getBook", &ngh::mkt::FtxHandler::getBook,
+      .def("onMessage", idle(&ngh::mkt::FtxHandler::onMessage))
+      .def("getBook",
+           idle(pybind11::overload_cast<std::string_view>(
+               &ngh::mkt::FtxHandler::getBook)),
            pybind11::return_value_policy::reference_internal)
-      .def_readwrite("balances", &ngh::mkt::FtxHandler::balances);
+      .def(
+          "getBook",
+          [](ngh::mkt::FtxHandler& self,
+             const ngh::MarketId id) -> ngh::mkt::L2StateTracker& {
+            self.checkIdle();
+            if (id >= self.getMarkets().size()) {
+              throw pybind11::index_error("no market with id " +
+                                          std::to_string(id));
+            }
+            return self.getBook(id);
+          },
+          pybind11::return_value_policy::reference_internal)
+      .def("topOfBookAll",
+           [](const ngh::mkt::FtxHandler& self) {
+             self.checkIdle();
+             CArray<ngh::mkt::TopOfBook> out(self.getMarkets().size());
+             self.getTops(asSpan(out));
+             return out;
+           })
+      .def(
+          "topOfBookAll",
+          [](const ngh::mkt::FtxHandler& self,
+             CArray<ngh::mkt::TopOfBook>& out) {
+            self.checkIdle();
+            return self.getTops(asSpan(out));
+          },
+          pybind11::arg("out").noconvert())
+      .def("exportOrders",
+           [](const ngh::mkt::FtxHandler& self) {
+             self.checkIdle();
+             CArray<ngh::OrderRow> out(self.numOrders());
+             self.exportOrders(asSpan(out));
+             return out;
+           })
+      .def("exportBalances",
+           [](const ngh::mkt::FtxHandler& self) {
+             self.checkIdle();
+             std::vector<std::string> ccys;
+             CArray<ngh::Qty> qty(self.balances.size());
+             ccys.reserve(self.balances.size());
+             auto* out = qty.mutable_data();
+             for (const auto& [ccy, q] : self.balances) {
+               ccys.push_back(ccy);
+               *out++ = q;
+             }
+             return pybind11::make_tuple(ccys, qty);
+           })
+      .def("getMarketId", idle(&ngh::mkt::FtxHandler::getMarketId))
+      .def("getMarkets", idle(&ngh::mkt::FtxHandler::getMarkets))
+      .def(
+          "attachSampler",
+          [](ngh::mkt::FtxHandler& self,
+             const std::vector<std::string>& markets, const size_t depth,
+             const CArrayCast<double>& grid, CArray<float>& out) {
+            self.checkIdle();
+            checkSamplerOutput(out, grid.size(), markets.size(), depth);
+            self.attachSampler(
+                markets, depth,
+                std::vector<double>(grid.data(), grid.data() + grid.size()),
+                out.mutable_data());
+          },
+          pybind11::arg("markets"), pybind11::arg("depth"),
+          pybind11::arg("grid"), pybind11::arg("out").noconvert(),
+          pybind11::keep_alive<1, 5>())
+      .def(
+          "attachSampler",
+          [](ngh::mkt::FtxHandler& self,
+             const std::vector<std::string>& markets, const size_t depth,
+             const double start, const double interval, CArray<float>& out) {
+            self.checkIdle();
+            const size_t rows = out.ndim() > 0 ? out.shape(0) : 0;
+            checkSamplerOutput(out, rows, markets.size(), depth);
+            std::vector<double> grid(rows);
+            for (size_t i = 0; i < rows; ++i) {
+              grid[i] = start + interval * i;
+            }
+            self.attachSampler(markets, depth, std::move(grid),
+                               out.mutable_data());
+          },
+          pybind11::arg("markets"), pybind11::arg("depth"),
+          pybind11::arg("start"), pybind11::arg("interval"),
+          pybind11::arg("out").noconvert(), pybind11::keep_alive<1, 6>())
+      .def("flushSampler",
+           [](ngh::mkt::FtxHandler& self) -> size_t {
+             self.checkIdle();
+             auto* sampler = self.getSampler();
+             if (!sampler) {
+               return 0;
+             }
+             sampler->flush();
+             return sampler->rows();
+           })
+      .def("detachSampler", idle(&ngh::mkt::FtxHandler::detachSampler))
+      .def(pybind11::pickle(
+          [](const ngh::mkt::FtxHandler& self) {
+            self.checkIdle();
+            return pybind11::bytes(ngh::mkt::saveState(self));
+          },
+          [](const pybind11::bytes& state) {
+            char* data;
+            ssize_t size;
+            PyBytes_AsStringAndSize(state.ptr(), &data, &size);
+            auto h = std::make_unique<ngh::mkt::FtxHandler>();
+            ngh::mkt::loadState(*h, {data, size_t(size)});
+            return h;
+          }))
+      .def(
+          "setCallback",
+          [](ngh::mkt::FtxHandler& self, pybind11::function fn,
+             const size_t max_events) {
+            self.checkIdle();
+            self.setEventSink(
+                [fn](std::span<const ngh::mkt::Event> events) {
+                  pybind11::gil_scoped_acquire gil;
+                  fn(CArray<ngh::mkt::Event>(events.size(), events.data()));
+                },
+                max_events);
+          },
+          pybind11::arg("fn"), pybind11::arg("max_events") = 1024)
+      .def("clearCallback", idle(&ngh::mkt::FtxHandler::clearEventSink))
+      .def(
+          "enableArbitration",
+          [](ngh::mkt::FtxHandler& self, const int64_t window_us) {
+            return self.enableArbitration(std::chrono::microseconds(window_us));
+          },
+          pybind11::arg("window_us") = 5000000)
+      .def("disableArbitration", &ngh::mkt::FtxHandler::disableArbitration)
+      .def("flushEvents",
+           [](ngh::mkt::FtxHandler& self) {
+             self.checkIdle();
+             if (auto* events = self.getEventBatcher()) {
+               events->flush();
+             }
+           })
+      .def("replayFile",
+           [](ngh::mkt::FtxHandler& self, const std::string& path) {
+             return applyWithoutGil(self, [&] {
+               ngh::io::CaptureReader source(path);
+               return ngh::mkt::replayAll(source, self);
+             });
+           })
+      .def(
+          "replayFileAhead",
+          [](ngh::mkt::FtxHandler& self, const std::string& path,
+             const size_t block_kb, const unsigned depth) {
+            return applyWithoutGil(self, [&] {
+              ngh::io::UringLineReader source(path, block_kb << 10, depth);
+              const auto n = ngh::mkt::replayAll(source, self);
+              return std::make_pair(n, source.stats());
+            });
+          },
+          pybind11::arg("path"),
+          pybind11::arg("block_kb") =
+              ngh::io::UringLineReader::kDefaultBlock >> 10,
+          pybind11::arg("depth") = ngh::io::UringLineReader::kDefaultDepth)
+      .def("replayFiles",
+           [](ngh::mkt::FtxHandler& self,
+              const std::vector<std::string>& paths) {
+             return applyWithoutGil(self, [&] {
+               ngh::io::MergedLineReader source(paths);
+               return ngh::mkt::replayAll(source, self);
+             });
+           })
+      .def(
+          "replayShards",
+          [](ngh::mkt::FtxHandler& self, const std::string& dir,
+             const std::vector<std::string>& markets, const bool account) {
+            return applyWithoutGil(self, [&] {
+              ngh::mkt::ShardReader source(dir, markets, account);
+              return ngh::mkt::replayAll(source, self);
+            });
+          },
+          pybind11::arg("dir"), pybind11::arg("markets"),
+          pybind11::arg("account") = true)
+      .def(
+          "replayEventLog",
+          [](ngh::mkt::FtxHandler& self, const std::string& path,
+             const std::optional<double> until) {
+            return applyWithoutGil(self, [&] {
+              ngh::io::EventLogReader log(path);
+              if (until) {  // from the nearest checkpoint
+                return ngh::mkt::seekEventLog(log, self, *until);
+              }
+              return ngh::mkt::replayEventLog(log, self);
+            });
+          },
+          pybind11::arg("path"), pybind11::arg("until") = pybind11::none())
+      .def("replayTickStore",
+           [](ngh::mkt::FtxHandler& self, const std::string& path) {
+             return applyWithoutGil(self, [&] {
+               ngh::io::TickStoreReader store(path);
+               return ngh::mkt::replayTickStore(store, self);
+             });
+           })
+      .def("startIngest", &ngh::mkt::FtxHandler::startIngest,
+           pybind11::arg("capacity_bytes") = 1 << 26,
+           pybind11::arg("max_markets") = 4096, pybind11::keep_alive<0, 1>())
+      .def("stopIngest", &ngh::mkt::FtxHandler::stopIngest,
+           pybind11::call_guard<pybind11::gil_scoped_release>())
+      .def(
+          "startFeed",
+          [](ngh::mkt::FtxHandler& self, const std::string& host,
+             const uint16_t port, const std::string& path,
+             const std::vector<std::string>& subscribe,
+             const size_t max_markets, const double ping_s,
+             const bool busy_poll, const int cpu,
+             const int busy_poll_us) {
+            const auto config =
+                feedConfig(ping_s, busy_poll, cpu, busy_poll_us);
+            pybind11::gil_scoped_release release;
+            return self.startFeed(host, port, path, subscribe, max_markets,
+                                  config);
+          },
+          pybind11::arg("host"), pybind11::arg("port"),
+          pybind11::arg("path") = "/ws",
+          pybind11::arg("subscribe") = std::vector<std::string>(),
+          pybind11::arg("max_markets") = 4096, pybind11::arg("ping_s") = 15.0,
+          pybind11::arg("busy_poll") = false, pybind11::arg("cpu") = -1,
+          pybind11::arg("busy_poll_us") = 0, pybind11::keep_alive<0, 1>())
+      .def("stopFeed", &ngh::mkt::FtxHandler::stopFeed,
+           pybind11::call_guard<pybind11::gil_scoped_release>())
+      .def_property_readonly("lastTs",
+                             [](const ngh::mkt::FtxHandler& self) {
+                               self.checkIdle();
+                               return self.lastTs;
+                             })
+      .def_property(
+          "balances",
+          [](ngh::mkt::FtxHandler& self) -> ngh::Balances& {
+            self.checkIdle();
+            return self.balances;
+          },
+          [](ngh::mkt::FtxHandler& self, const ngh::Balances& balances) {
+            self.checkIdle();
+            self.balances = balances;
+          });
+
+  pybind11::class_<FileReplayer>(m_mkt, "Replay")
+      .def("__iter__", [](pybind11::object self) { return self; })
+      .def("__next__",
+           [](pybind11::object obj) {
+             auto& self = obj.cast<FileReplayer&>();
+             bool more;
+             {
+               const ngh::mkt::FtxHandler::Applying applying(self.handler());
+               pybind11::gil_scoped_release release;
+               more = self.next();
+             }
+             if (!more) {
+               throw pybind11::stop_iteration();
+             }
+             // view into the replayer, overwritten by the next iteration
+             CArray<float> book({self.numMarkets(), self.depth(),
+                                 size_t(ngh::mkt::BookSampler::kNumFields)},
+                                self.snapshot().data(), obj);
+             book.attr("setflags")(pybind11::arg("write") = false);
+             return pybind11::make_tuple(self.ts(), book);
+           })
+      .def_property_readonly("handler", &FileReplayer::handler,
+                             pybind11::return_value_policy::reference_internal)
+      .def_property_readonly("count", &FileReplayer::count);
+
+  m.def(
+      "replay",
+      [](const std::string& path, const std::vector<std::string>& markets,
+         const size_t depth, const std::optional<double> every_ms,
+         const std::optional<size_t> every_n, const std::optional<double> start,
+         const double index_ms) {
+        if (every_ms.has_value() == every_n.has_value() ||
+            every_ms.value_or(1.) <= 0. || every_n.value_or(1) == 0) {
+          throw std::invalid_argument(
+              "exactly one positive every_ms or every_n is required");
+        }
+        auto r = std::make_unique<FileReplayer>(path, markets, depth,
+                                                every_ms.value_or(0.) / 1e3,
+                                                every_n.value_or(0));
+        if (start) {
+          pybind11::gil_scoped_release release;
+          r->seek(ngh::mkt::CaptureIndex::open(path, index_ms / 1e3), *start);
+        }
+        return r;
+      },
+      pybind11::arg("path"), pybind11::arg("markets"),
+      pybind11::arg("depth") = 10, pybind11::arg("every_ms") = pybind11::none(),
+      pybind11::arg("every_n") = pybind11::none(),
+      pybind11::arg("start") = pybind11::none(),
+      pybind11::arg("index_ms") = 1000.);
+
+  m.def(
+      "replayBatch",
+      [](const std::vector<std::string>& paths,
+         const std::vector<std::string>& markets,
+         const CArrayCast<double>& starts, const double interval_ms,
+         const size_t rows, const size_t depth, const size_t threads) {
+        if (size_t(starts.size()) != paths.size()) {
+          throw std::invalid_argument("one start per path is required");
+        }
+        CArray<float> out({paths.size(), rows, markets.size(), depth,
+                           size_t(ngh::mkt::BookSampler::kNumFields)});
+        CArray<ngh::mkt::BatchStats> stats(paths.size());
+        {
+          pybind11::gil_scoped_release release;
+          ngh::mkt::replayBatch<ngh::io::CaptureReader>(
+              paths, markets, depth, {starts.data(), size_t(starts.size())},
+              interval_ms / 1e3, rows, out.mutable_data(),
+              stats.mutable_data(), threads);
+        }
+        return pybind11::make_tuple(out, stats);
+      },
+      pybind11::arg("paths"), pybind11::arg("markets"), pybind11::arg("starts"),
+      pybind11::arg("interval_ms"), pybind11::arg("rows"),
+      pybind11::arg("depth") = 10, pybind11::arg("threads") = 0);
+
+  m.def(
+      "replayByMarket",
+      [](const std::string& path, const std::vector<std::string>& markets,
+         const double start, const double interval_ms, const size_t rows,
+         const size_t depth, const size_t threads) {
+        CArray<float> out({rows, markets.size(), depth,
+                           size_t(ngh::mkt::BookSampler::kNumFields)});
+        std::vector<double> grid(rows);
+        for (size_t i = 0; i < rows; ++i) {
+          grid[i] = start + interval_ms / 1e3 * i;
+        }
+        auto merged = std::make_unique<ngh::mkt::FtxHandler>();
+        {
+          pybind11::gil_scoped_release release;
+          ngh::mkt::replayByMarket(path, markets, depth, grid,
+                                   out.mutable_data(), threads, merged.get());
+        }
+        return pybind11::make_tuple(out, std::move(merged));
+      },
+      pybind11::arg("path"), pybind11::arg("markets"), pybind11::arg("start"),
+      pybind11::arg("interval_ms"), pybind11::arg("rows"),
+      pybind11::arg("depth") = 10, pybind11::arg("threads") = 0);
+
+  m.def(
+      "indexCapture",
+      [](const std::string& path, const double interval_ms) {
+        const auto index =
+            ngh::mkt::CaptureIndex::build(path, interval_ms / 1e3);
+        index.save(ngh::mkt::CaptureIndex::sidecar(path));
+        return index.times.size();
+      },
+      pybind11::arg("path"), pybind11::arg("interval_ms") = 1000.,
+      pybind11::call_guard<pybind11::gil_scoped_release>());
+
+  m.def(
+      "splitCapture",
+      [](const std::string& src, const std::string& dir) {
+        const auto manifest = ngh::mkt::splitCapture(src, dir);
+        std::map<std::string, uint64_t> lines;
+        for (const auto& [market, shard] : manifest.markets) {
+          lines.emplace(market, shard.lines);
+        }
+        return lines;
+      },
+      pybind11::arg("src"), pybind11::arg("dir"),
+      pybind11::call_guard<pybind11::gil_scoped_release>());
+
+  m.def(
+      "convertEventLog",
+      [](const std::string& src, const std::string& dst,
+         const std::optional<double> checkpoint_min) {
+        ngh::io::CaptureReader source(src);
+        ngh::io::EventLogWriter out(dst);
+        const auto n = ngh::mkt::convertEventLog(
+            source, out, checkpoint_min.value_or(0.) * 60.);
+        out.close();
+        return n;
+      },
+      pybind11::arg("src"), pybind11::arg("dst"),
+      pybind11::arg("checkpoint_min") = pybind11::none(),
+      pybind11::call_guard<pybind11::gil_scoped_release>());
+
+  m.def(
+      "convertTickStore",
+      [](const std::string& src, const std::string& dst) {
+        ngh::io::CaptureReader source(src);
+        ngh::io::TickStoreWriter out(dst);
+        const auto n = ngh::mkt::convertTickStore(source, out);
+        out.close();
+        return n;
+      },
+      pybind11::arg("src"), pybind11::arg("dst"),
+      pybind11::call_guard<pybind11::gil_scoped_release>());
 }
 
 }  // namespace pycc
@@ -0,0 +1,462 @@
+// Serves a capture file to any number of local clients, as if it were the
+// exchange feed: every connection gets its own pass over the capture, paced
+// by the event times in it.
+//
+//   replayserver day.ndjson.gz --port 8765 --speed 10
+//   replayserver day.ndjson --mode unix --path /tmp/feed.sock --speed 0
+//
+// Modes: "ws" sends one WebSocket text message per line, "tcp" and "unix"
+// send the raw lines newline delimited. Speed 1 is real time, N is N times
+// faster and 0 is as fast as the client reads.
+//
+// WebSocket clients are read from like the exchange would: pings (frames,
+// and {"op": "ping"}) are answered, a close from the client ends the
+// session, and subscriptions are acknowledged. Subscriptions only select
+// what is sent with --filter; otherwise every client gets every line.
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+// asio's scheduler trips gcc's -Wnull-dereference
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wnull-dereference"
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#pragma GCC diagnostic pop
+#include <boost/log/trivial.hpp>
+#include <boost/program_options.hpp>
+
+#include "ngh/io/capturereader.h"
+#include "ngh/io/scan.h"
+#include "ngh/types/types.h"
+
+namespace asio = boost::asio;
+namespace beast = boost::beast;
+namespace po = boost::program_options;
+using tcp = asio::ip::tcp;
+using local = asio::local::stream_protocol;
+
+namespace {
+
+struct Options {
+  std::string capture;
+  std::string mode;
+  std::string path;
+  uint16_t port;
+  double speed;
+  bool filter;
+};
+
+// Maps capture time to wall time: the first timed line goes out at once, the
+// rest at their distance from it divided by `speed`. Lines without a time go
+// with the line before them.
+class Pacer {
+ public:
+  explicit Pacer(const double speed) : speed_(speed) {}
+
+  // True if `line` is not due yet, with `at` set to when it is.
+  bool due(const std::string_view line, ngh::SteadyTime& at) {
+    if (speed_ <= 0.) {
+      return false;
+    }
+    const double t = ngh::io::scanAnyTime(line);
+    if (std::isnan(t)) {
+      return false;
+    }
+    const auto now = ngh::SteadyClock::now();
+    if (std::isnan(t0_)) {
+      t0_ = t;
+      wall0_ = now;
+      return false;
+    }
+    at = wall0_ + std::chrono::duration_cast<ngh::Duration>(
+                      std::chrono::duration<double>((t - t0_) / speed_));
+    return at > now;
+  }
+
+ private:
+  double speed_;
+  double t0_{NAN};
+  ngh::SteadyTime wall0_;
+};
+
+struct SessionStats {
+  uint64_t messages{0};
+  uint64_t bytes{0};
+};
+
+// Lines are batched into few writes while they are due anyway and flushed
+// before every wait, so pacing is exact and as-fast-as-possible is cheap.
+template <typename Socket>
+void streamRaw(Socket& socket, const Options& opts, SessionStats& stats) {
+  constexpr size_t kFlushSize = 1 << 16;
+  ngh::io::CaptureReader reader(opts.capture);
+  Pacer pacer(opts.speed);
+  std::string out;
+  const auto flush = [&] {
+    asio::write(socket, asio::buffer(out));
+    stats.bytes += out.size();
+    out.clear();
+  };
+  std::string_view line;
+  ngh::SteadyTime at;
+  while (reader.next(line)) {
+    if (pacer.due(line, at)) {
+      flush();
+      std::this_thread::sleep_until(at);
+    }
+    out.append(line);
+    out.push_back('\n');
+    ++stats.messages;
+    if (out.size() >= kFlushSize) {
+      flush();
+    }
+  }
+  flush();
+}
+
+// Streams the capture over a websocket while reading from it, all on the
+// session's own io_context: beast answers ping frames and completes the
+// close handshake only while a read is pending, and a stream may only have
+// one write in flight, so lines and replies to the client share one queue.
+class WebSocketSession {
+ public:
+  // the client gets this long after its first subscription to send the rest
+  static constexpr auto kSettle = std::chrono::milliseconds(100);
+
+  WebSocketSession(tcp::socket socket, const Options& opts,
+                   SessionStats& stats)
+      : ws_(std::move(socket)),
+        timer_(ws_.get_executor()),
+        opts_(opts),
+        stats_(stats),
+        reader_(opts.capture),
+        pacer_(opts.speed),
+        started_(!opts.filter) {}
+
+  void run() {
+    ws_.accept();
+    ws_.text(true);
+    read();
+    pump();
+    static_cast<asio::io_context&>(ws_.get_executor().context()).run();
+    if (!error_.empty()) {
+      throw std::runtime_error(error_);
+    }
+  }
+
+ private:
+  void read() {
+    ws_.async_read(in_, [this](const beast::error_code ec, size_t) {
+      if (ec) {
+        // closed by the client, or after our close completed
+        if (!closing_ && ec != beast::websocket::error::closed) {
+          fail(ec);
+        }
+        closing_ = true;
+        timer_.cancel();
+        return;
+      }
+      onMessage(beast::buffers_to_string(in_.data()));
+      in_.consume(in_.size());
+      read();
+    });
+  }
+
+  void onMessage(const std::string& msg) {
+    const auto op = ngh::io::scanString(msg, "op");
+    const auto channel = std::string(ngh::io::scanString(msg, "channel"));
+    const auto market = std::string(ngh::io::scanString(msg, "market"));
+    std::string reply;
+    if (op == "ping") {
+      reply = R"({"type": "pong"})";
+    } else if (op == "subscribe" || op == "unsubscribe") {
+      if (op == "subscribe") {
+        subscriptions_.emplace(channel, market);
+      } else {
+        subscriptions_.erase({channel, market});
+      }
+      reply = R"({"type": ")" + std::string(op) + R"(d", "channel": ")" +
+              channel + R"(", "market": ")" + market + R"("})";
+      if (!started_ && !waiting_) {
+        waiting_ = true;
+        timer_.expires_after(kSettle);
+        timer_.async_wait([this](const beast::error_code ec) {
+          waiting_ = false;
+          started_ = !ec;
+          pump();
+        });
+      }
+    } else {
+      return;
+    }
+    replies_.push_back(std::move(reply));
+    pump();
+  }
+
+  // Starts the next write, if none is in flight: replies first, then the
+  // current line once it is due.
+  void pump() {
+    if (writing_ || closing_) {
+      return;
+    }
+    if (!replies_.empty()) {
+      write(replies_.front(), false);
+      return;
+    }
+    if (!started_ || waiting_ || (!haveLine_ && !advance())) {
+      return;
+    }
+    haveLine_ = false;
+    write(line_, true);
+  }
+
+  // Moves to the next line to send; false if it isn't due yet (the timer
+  // pumps again then) or the capture is done.
+  bool advance() {
+    while (reader_.next(line_)) {
+      if (!wanted(line_)) {
+        continue;
+      }
+      haveLine_ = true;
+      ngh::SteadyTime at;
+      if (!pacer_.due(line_, at)) {
+        return true;
+      }
+      waiting_ = true;
+      timer_.expires_at(at);
+      timer_.async_wait([this](const beast::error_code ec) {
+        waiting_ = false;
+        if (!ec) {
+          pump();
+        }
+      });
+      return false;
+    }
+    closing_ = true;
+    ws_.async_close(beast::websocket::close_code::normal,
+                    [this](const beast::error_code ec) {
+                      if (ec) {
+                        fail(ec);
+                      }
+                    });
+    return false;
+  }
+
+  bool wanted(const std::string_view line) const {
+    if (!opts_.filter) {
+      return true;
+    }
+    const auto channel = std::string(ngh::io::scanString(line, "channel"));
+    if (channel.empty()) {
+      return true;
+    }
+    const auto market = std::string(ngh::io::scanString(line, "market"));
+    return subscriptions_.count({channel, market}) ||
+           subscriptions_.count({channel, ""});
+  }
+
+  void write(const std::string_view msg, const bool isLine) {
+    writing_ = true;
+    ws_.async_write(asio::buffer(msg.data(), msg.size()),
+                    [this, isLine](const beast::error_code ec, size_t n) {
+                      writing_ = false;
+                      if (ec) {
+                        fail(ec);
+                        return;
+                      }
+                      if (isLine) {
+                        ++stats_.messages;
+                        stats_.bytes += n;
+                      } else {
+                        replies_.pop_front();
+                      }
+                      pump();
+                    });
+  }
+
+  void fail(const beast::error_code ec) {
+    closing_ = true;
+    timer_.cancel();
+    // a write cut short by the client's close, which the read completes
+    if (ec == asio::error::operation_aborted ||
+        ec == beast::websocket::error::closed) {
+      return;
+    }
+    if (error_.empty()) {
+      error_ = ec.message();
+    }
+    beast::error_code ignored;
+    beast::get_lowest_layer(ws_).close(ignored);
+  }
+
+  beast::websocket::stream<tcp::socket> ws_;
+  asio::steady_timer timer_;
+  const Options& opts_;
+  SessionStats& stats_;
+  ngh::io::CaptureReader reader_;
+  Pacer pacer_;
+  beast::flat_buffer in_;
+  std::set<std::pair<std::string, std::string>> subscriptions_;
+  std::deque<std::string> replies_;
+  std::string_view line_;
+  bool haveLine_{false};
+  bool started_;
+  bool waiting_{false};
+  bool writing_{false};
+  bool closing_{false};
+  std::string error_;
+};
+
+template <typename Stream>
+void session(Stream&& run, const std::string& peer) {
+  BOOST_LOG_TRIVIAL(info) << peer << " connected";
+  SessionStats stats;
+  const auto t0 = ngh::SteadyClock::now();
+  try {
+    run(stats);
+  } catch (const std::exception& e) {
+    BOOST_LOG_TRIVIAL(info) << peer << " dropped: " << e.what();
+  }
+  const double seconds =
+      std::chrono::duration<double>(ngh::SteadyClock::now() - t0).count();
+  BOOST_LOG_TRIVIAL(info) << peer << " done: " << stats.messages
+                          << " messages, " << stats.bytes << " bytes in "
+                          << seconds << "s ("
+                          << stats.messages / std::max(seconds, 1e-9)
+                          << " msg/s)";
+}
+
+// Every connection gets a thread, an io_context and a copy of the options of
+// its own, so that sessions outlive serve() if accepting fails.
+template <typename Acceptor>
+[[noreturn]] void serve(Acceptor& acceptor, const Options& opts) {
+  for (;;) {
+    auto io = std::make_unique<asio::io_context>();
+    typename Acceptor::protocol_type::socket socket(*io);
+    acceptor.accept(socket);
+    std::thread([opts, io = std::move(io),
+                 socket = std::move(socket)]() mutable {
+      std::string peer;
+      if constexpr (std::is_same_v<decltype(socket), tcp::socket>) {
+        // the client may be gone already, which the session then reports
+        beast::error_code ec;
+        const auto ep = socket.remote_endpoint(ec);
+        peer = ec ? "unknown peer"
+                  : ep.address().to_string() + ":" + std::to_string(ep.port());
+        socket.set_option(tcp::no_delay(true), ec);
+        if (opts.mode == "ws") {
+          session(
+              [&](SessionStats& stats) {
+                WebSocketSession(std::move(socket), opts, stats).run();
+              },
+              peer);
+          return;
+        }
+      } else {
+        peer = opts.path;
+      }
+      session([&](SessionStats& stats) { streamRaw(socket, opts, stats); },
+              peer);
+    }).detach();
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options opts;
+  po::options_description desc("replayserver options");
+  desc.add_options()                                            //
+      ("help,h", "show this help")                              //
+      ("capture", po::value(&opts.capture)->required(),         //
+       "capture file (.ndjson or .ndjson.gz)")                  //
+      ("mode", po::value(&opts.mode)->default_value("ws"),      //
+       "ws, tcp or unix")                                       //
+      ("port", po::value(&opts.port)->default_value(8765),      //
+       "port to listen on (ws, tcp), on localhost")             //
+      ("path", po::value(&opts.path),                           //
+       "socket path to listen on (unix)")                       //
+      ("speed", po::value(&opts.speed)->default_value(1.),      //
+       "1 for real time, N for N times faster, 0 for no pacing")  //
+      ("filter", po::bool_switch(&opts.filter),                 //
+       "ws: send each client only the channels and markets it "
+       "subscribed to, from shortly after its first subscription");
+  po::positional_options_description positional;
+  positional.add("capture", 1);
+
+  try {
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv)
+                  .options(desc)
+                  .positional(positional)
+                  .run(),
+              vm);
+    if (vm.count("help")) {
+      std::cout << desc << std::endl;
+      return 0;
+    }
+    po::notify(vm);
+    if (opts.mode != "ws" && opts.mode != "tcp" && opts.mode != "unix") {
+      throw std::invalid_argument("unknown mode " + opts.mode);
+    }
+    if (opts.mode == "unix" && opts.path.empty()) {
+      throw std::invalid_argument("unix mode needs --path");
+    }
+    if (opts.speed < 0.) {
+      throw std::invalid_argument("speed must not be negative");
+    }
+    ngh::io::CaptureReader probe(opts.capture);  // fail early on a bad path
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << "\n\n" << desc << std::endl;
+    return 1;
+  }
+
+  asio::io_context io;
+  try {
+    if (opts.mode == "unix") {
+      // replace a stale socket, but nothing else
+      struct stat st;
+      if (::lstat(opts.path.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+          throw std::runtime_error(opts.path + " exists and is not a socket");
+        }
+        ::unlink(opts.path.c_str());
+      } else if (errno != ENOENT) {
+        throw std::runtime_error("failed to stat " + opts.path + ": " +
+                                 std::strerror(errno));
+      }
+      local::acceptor acceptor(io, local::endpoint(opts.path));
+      BOOST_LOG_TRIVIAL(info) << "serving " << opts.capture << " on "
+                              << opts.path << " at speed " << opts.speed;
+      serve(acceptor, opts);
+    } else {
+      tcp::acceptor acceptor(
+          io, tcp::endpoint(asio::ip::address_v4::loopback(), opts.port));
+      BOOST_LOG_TRIVIAL(info)
+          << "serving " << opts.capture << " (" << opts.mode << ") on port "
+          << acceptor.local_endpoint().port() << " at speed " << opts.speed;
+      serve(acceptor, opts);
+    }
+  } catch (const std::exception& e) {
+    BOOST_LOG_TRIVIAL(error) << e.what();
+    return 1;
+  }
+}